@@ -1,13 +1,17 @@
 /*
  * Bitcoin Miner SDK for Zybo Z-10 - Xilinx SDK Version
  * Interfaces with FPGA SHA-256 miner
+ * Runs bare-metal, under PetaLinux through UIO (-DMINER_USE_UIO), or on a
+ * host against a software model of the cores (-DMINER_USE_SIM)
  * 
- * Base Address: 0x43C00000
+ * Base Address: 0x43C00000 (core 0; further cores every MINER_CORE_STRIDE)
  * Register Map:
- * Bank 0: Control registers
+ * Bank 0: Control/status registers, incl. START_NONCE/END_NONCE range
  * Bank 1: MID_STATE (8 x 32-bit)
- * Bank 2: RESIDUAL_DATA (3 x 32-bit)
- * Bank 3: TARGET (8 x 32-bit)
+ * Bank 2: RESIDUAL_DATA (3 x 32-bit: merkle tail, timestamp, bits)
+ * Bank 3: TARGET (8 x 32-bit, word 0 = least significant)
+ * Bank 5-7: NEXT job shadow copies of banks 1-3 (see CTRL_JOB_COMMIT)
+ * Job table: optional per-core descriptor ring in BRAM (MINER_USE_JOB_TABLE)
  */
 
 #include <stdio.h>
@@ -15,30 +19,210 @@
 #include <string.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <time.h>
+
+// Register access backend, chosen at build time: bare-metal Xil_Out32/
+// Xil_In32 by default, -DMINER_USE_UIO for a PetaLinux userspace driver
+// that mmap()s the miner's UIO region and takes its interrupt through
+// read() on the UIO file descriptor, or -DMINER_USE_SIM for a software
+// model of the core that runs on any Linux host (link with -pthread)
+#ifdef MINER_USE_UIO
+#if !defined(__linux__) || defined(MINER_USE_IRQ) || defined(MINER_USE_SIM)
+#error "MINER_USE_UIO needs Linux and replaces MINER_USE_IRQ"
+#endif
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#elif defined(MINER_USE_SIM)
+#if !defined(__linux__) || defined(MINER_USE_IRQ)
+#error "MINER_USE_SIM runs on a Linux host and has no interrupt line"
+#endif
+#include <pthread.h>
+#else
 #include "xil_io.h"
 #include "xil_types.h"
 #include "xparameters.h"
+#endif
+#ifndef __linux__
+#include "xtime_l.h"
+#endif
+
+// Host SHA-256 uses the NEON 4-lane kernel when the compiler targets NEON
+// (e.g. -mfpu=neon on the Cortex-A9); -DMINER_NO_NEON forces scalar code
+#if defined(__ARM_NEON) && !defined(MINER_NO_NEON)
+#include <arm_neon.h>
+#define SHA256_USE_NEON 1
+#else
+#define SHA256_USE_NEON 0
+#endif
+
+// Build with -DMINER_USE_IRQ to take FOUND/NOT_FOUND events from the
+// miner's interrupt line through the GIC instead of polling
+#ifdef MINER_USE_IRQ
+#include "xscugic.h"
+#include "xil_exception.h"
+#endif
+
+// Build with -DMINER_USE_JOB_TABLE when the cores fetch follow-on jobs
+// from a descriptor ring in BRAM instead of the shadow banks
+#if defined(MINER_USE_JOB_TABLE) && !defined(__linux__)
+#include "xil_mmu.h"
+#endif
+
+// Build with -DMINER_USE_PREP_THREAD (Linux) to run job preparation on
+// its own thread next to the device loop
+#ifdef MINER_USE_PREP_THREAD
+#ifndef __linux__
+#error "MINER_USE_PREP_THREAD needs Linux (pthreads)"
+#endif
+#include <pthread.h>
+#endif
+
+// Build with -DMINER_USE_STRATUM for the pool client (Linux sockets, or
+// the lwIP socket API on standalone/FreeRTOS builds)
+#ifdef MINER_USE_STRATUM
+#include <errno.h>
+#ifdef __linux__
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netdb.h>
+#include <fcntl.h>
+#define stratum_close close
+#else
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+#define stratum_close lwip_close
+#endif
+#endif
+
+// Build with -DMINER_USE_CLUSTER for multi-board operation over UDP: a
+// coordinator (mode=coordinator, also needs MINER_USE_STRATUM) holds the
+// pool session and hands jobs to boards (mode=board)
+#ifdef MINER_USE_CLUSTER
+#include <errno.h>
+#ifdef __linux__
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <fcntl.h>
+#define cluster_close close
+#else
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+#define cluster_close lwip_close
+#endif
+#endif
 
 // Base address from block design
 #define MINER_BASE_ADDR 0x43C00000
 
+// Miner core instances. Defaults come from xparameters.h when the design
+// exports them; otherwise cores follow MINER_BASE_ADDR at MINER_CORE_STRIDE.
+// MINER_CORE_BASE_ADDRS may list explicit base addresses instead.
+#ifndef MINER_NUM_CORES
+#ifdef XPAR_MINER_NUM_INSTANCES
+#define MINER_NUM_CORES XPAR_MINER_NUM_INSTANCES
+#else
+#define MINER_NUM_CORES 1
+#endif
+#endif
+
+#ifndef MINER_CORE_STRIDE
+#define MINER_CORE_STRIDE 0x10000
+#endif
+
+#ifndef MINER_CORE_BASE_ADDRS
+#define MINER_CORE_BASE_ADDRS { 0 }  // 0 = MINER_BASE_ADDR + i * stride
+#endif
+
+// Miner interrupt on the PL-to-PS interrupt bus (IRQ_F2P[0] by default)
+#ifndef MINER_IRQ_ID
+#ifdef XPAR_FABRIC_MINER_0_IRQ_INTR
+#define MINER_IRQ_ID XPAR_FABRIC_MINER_0_IRQ_INTR
+#else
+#define MINER_IRQ_ID 61
+#endif
+#endif
+
 // Register bank offsets
 #define BANK_0_OFFSET 0x0000  // Control registers
 #define BANK_1_OFFSET 0x0100  // MID_STATE
 #define BANK_2_OFFSET 0x0200  // RESIDUAL_DATA  
 #define BANK_3_OFFSET 0x0300  // TARGET
 
+// Shadow ("next job") banks sit at the active bank offset + 0x400
+#define SHADOW_BANK_DELTA 0x0400
+#define BANK_5_OFFSET (BANK_1_OFFSET + SHADOW_BANK_DELTA)  // NEXT_MID_STATE
+#define BANK_6_OFFSET (BANK_2_OFFSET + SHADOW_BANK_DELTA)  // NEXT_RESIDUAL_DATA
+#define BANK_7_OFFSET (BANK_3_OFFSET + SHADOW_BANK_DELTA)  // NEXT_TARGET
+
 // Control register offsets
 #define CTRL_SRST            0x0000
 #define CTRL_START           0x0004
+#define CTRL_JOB_COMMIT      0x0008  // Commit shadow banks (JOB_COMMIT_* bits)
 #define CTRL_CURRENT_HASH_REQ 0x0010
+#define CTRL_IRQ_ENABLE      0x0014  // Per-event interrupt enable mask
+#define CTRL_IRQ_ACK         0x0018  // Write 1 to clear a pending event
+#define CTRL_START_NONCE     0x0020  // First nonce of the active range
+#define CTRL_END_NONCE       0x0024  // Last nonce (inclusive), then NOT_FOUND
+#define CTRL_NEXT_START_NONCE 0x0028 // Range of the shadow job, latched
+#define CTRL_NEXT_END_NONCE  0x002C  // together with CTRL_JOB_COMMIT
 
 // Status register offsets (read-only)
 #define STATUS_FOUND         0x0000
 #define STATUS_NOT_FOUND     0x0004
 #define STATUS_GOLDEN_NONCE  0x0008
 #define STATUS_CURRENT_NONCE 0x000C
+#define STATUS_JOB_PENDING   0x0010  // Committed shadow job not yet active
+#define STATUS_JOB_SWAPPED   0x0014  // Sticky, cleared through CTRL_IRQ_ACK
+#define STATUS_RESULT_COUNT  0x0018  // Golden nonces waiting in the result FIFO
+#define STATUS_RESULT_POP    0x001C  // Reading pops the oldest golden nonce
+
+// Result FIFO: the core keeps hashing after a hit and FOUND stays set
+// while the FIFO holds results
+#define RESULT_FIFO_DEPTH    16
+#define RESULT_FIFO_OVERFLOW 0x80000000  // STATUS_RESULT_COUNT: results were lost
+#define RESULT_FIFO_COUNT_MASK 0x0000FFFF
+
+// Optional performance counters, present when the core is built with them
+// (-DMINER_HAS_PERF_COUNTERS); otherwise hashrate is derived from nonce
+// progress. All count since the last START and wrap at 32 bits.
+#define STATUS_HASH_COUNT    0x0030  // Hashes completed
+#define STATUS_CYCLE_COUNT   0x0034  // Core clock cycles
+#define STATUS_IDLE_CYCLES   0x0038  // Cycles with the pipeline empty
+
+// Miner core clock (FCLK_CLK0 by default), to turn cycle counts into time
+#ifndef MINER_CORE_CLOCK_HZ
+#define MINER_CORE_CLOCK_HZ 100000000
+#endif
+
+// Job table registers (MINER_USE_JOB_TABLE builds). Both are free-running
+// descriptor counts; the ring slot is count % JOB_TABLE_ENTRIES.
+#define CTRL_DESC_DOORBELL   0x0040  // Descriptors written so far
+#define STATUS_DESC_FETCHED  0x0040  // Descriptors taken by the core; SRST
+                                     // drops the rest (fetched = doorbell)
+
+// CTRL_JOB_COMMIT bits
+#define JOB_COMMIT_NOW         0x1  // Swap immediately, restart at CTRL_START_NONCE
+#define JOB_COMMIT_ON_ROLLOVER 0x2  // Swap when the current range is exhausted
+
+// Miner events (IRQ enable/ack bits and miner_wait_event() result)
+#define MINER_EVENT_FOUND     0x1
+#define MINER_EVENT_NOT_FOUND 0x2
+#define MINER_EVENT_JOB_SWAP  0x4
+#define MINER_EVENT_ALL       (MINER_EVENT_FOUND | MINER_EVENT_NOT_FOUND | MINER_EVENT_JOB_SWAP)
+
+// Status poll interval used when no interrupt line is available
+#ifndef MINER_POLL_INTERVAL_US
+#define MINER_POLL_INTERVAL_US 1000
+#endif
+
+// Compact bits of the current Bitcoin network target
+#define BTC_MAINNET_BITS     0x1703FFFC
 
 // Bitcoin block header structure
 typedef struct {
@@ -54,155 +238,4993 @@ typedef struct {
 typedef struct {
     uint32_t mid_state[8];      // SHA-256 mid-state
     uint32_t residual_data[3];  // Remaining block data
-    uint32_t target[8];         // Difficulty target
+    uint32_t target[8];         // Difficulty target (word 0 = least significant)
 } mining_params_t;
 
-// Xilinx SDK memory-mapped I/O functions
-void write_register(uint32_t offset, uint32_t value) {
-    Xil_Out32(MINER_BASE_ADDR + offset, value);
-    printf("Write: 0x%08X = 0x%08X\n", MINER_BASE_ADDR + offset, value);
+// Block header exactly as hashed and sent on the wire: 80 bytes,
+// integers little-endian (see le32_to_host()), hashes in internal byte
+// order. Byte 64 onwards is the second SHA-256 chunk.
+typedef struct __attribute__((packed)) {
+    uint32_t version;
+    uint8_t prev_block[32];
+    uint8_t merkle_root[32];
+    uint32_t timestamp;
+    uint32_t bits;
+    uint32_t nonce;
+} block_header_wire_t;
+
+_Static_assert(sizeof(block_header_wire_t) == 80, "wire header must be 80 bytes");
+
+// Job descriptor in the layout the core reads from the job table or a
+// DMA buffer: banks 1-3 in bank order, then the job id and nonce range.
+// Aligned so a ring entry never straddles a cache line (128 bytes).
+typedef struct {
+    mining_params_t params;  // Words 0x00-0x12
+    uint32_t job_id;         // Word 0x13
+    uint32_t nonce_start;    // Word 0x14
+    uint32_t nonce_end;      // Word 0x15, inclusive
+} __attribute__((aligned(64))) miner_job_desc_t;
+
+_Static_assert(sizeof(miner_job_desc_t) % 64 == 0, "descriptor must fill whole cache lines");
+_Static_assert(offsetof(miner_job_desc_t, job_id) == 0x4C, "descriptor layout is fixed by the core");
+
+// Register trace: build with -DMINER_TRACE=1 to compile the verbose
+// register log in, then toggle it at runtime with miner_trace_enabled.
+// Register accesses go to the event log; TRACE_PRINTF is left for the
+// off-path header dumps. With MINER_TRACE=0 (default) the register
+// helpers are bare MMIO accesses.
+#ifndef MINER_TRACE
+#define MINER_TRACE 0
+#endif
+
+#if MINER_TRACE
+int miner_trace_enabled = 1;
+#define TRACE_PRINTF(...) do { if (miner_trace_enabled) printf(__VA_ARGS__); } while (0)
+#define TRACE_EVENT(...)  do { if (miner_trace_enabled) event_log_append(__VA_ARGS__); } while (0)
+#else
+#define TRACE_PRINTF(...) do { } while (0)
+#define TRACE_EVENT(...)  do { } while (0)
+#endif
+
+// Monotonic time in microseconds (global timer on bare metal)
+uint64_t miner_time_us(void) {
+#ifdef __linux__
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+#else
+    XTime now;
+    XTime_GetTime(&now);
+    return (now / COUNTS_PER_SECOND) * 1000000 +
+           ((now % COUNTS_PER_SECOND) * 1000000) / COUNTS_PER_SECOND;
+#endif
+}
+
+// Monotonic time in nanoseconds, for timing single driver operations
+uint64_t miner_time_ns(void) {
+#ifdef __linux__
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+#else
+    XTime now;
+    XTime_GetTime(&now);
+    return (now / COUNTS_PER_SECOND) * 1000000000 +
+           ((now % COUNTS_PER_SECOND) * 1000000000) / COUNTS_PER_SECOND;
+#endif
+}
+
+// Event log: fixed-size binary ring that hot paths append to without I/O
+// or locks (one atomic add and a few stores, also from the IRQ handler).
+// event_log_drain() formats entries to the sink, stdout (UART) unless
+// event_log_set_sink() redirects it, from the idle side of the loops.
+// When producers lap the drain the oldest entries are overwritten and
+// counted as dropped.
+#ifndef EVENT_LOG_SIZE
+#define EVENT_LOG_SIZE 1024  // Entries, must be a power of two
+#endif
+
+#ifndef EVENT_LOG_DRAIN_BATCH
+#define EVENT_LOG_DRAIN_BATCH 32  // Entries formatted per idle pass
+#endif
+
+// Event ids and their arguments
+#define EVLOG_REG_WRITE      1  // addr, value (MINER_TRACE)
+#define EVLOG_REG_READ       2  // addr, value (MINER_TRACE)
+#define EVLOG_CORE_START     3  // core
+#define EVLOG_CORE_STOP      4  // core
+#define EVLOG_JOB_LOAD       5  // core, job id, first nonce, last nonce
+#define EVLOG_DESC_POST      6  // core, count, ring head
+#define EVLOG_JOB_SWAP       7  // core, chunk
+#define EVLOG_RANGE_DONE     8  // core
+#define EVLOG_GOLDEN_NONCE   9  // core, job id, nonce
+#define EVLOG_HW_ERROR      10  // nonce, bad, total
+#define EVLOG_FIFO_OVERFLOW 11  // core
+#define EVLOG_RESTART       12  // generation
+#define EVLOG_CLOCK_SET     13  // old kHz, new kHz, bad nonces, verified nonces
+#define EVLOG_ID_COUNT      14
+
+// Timestamps are raw ticks, converted when drained
+#ifdef __linux__
+#define EVENT_LOG_TICKS_PER_SEC 1000000
+#else
+#define EVENT_LOG_TICKS_PER_SEC COUNTS_PER_SECOND
+#endif
+
+typedef struct {
+    uint32_t sequence;  // Position + 1 once written, 0 while being written
+    uint32_t id;
+    uint64_t ticks;
+    uint32_t args[4];
+} event_log_entry_t;
+
+typedef void (*event_log_sink_t)(const char* line, void* ctx);
+
+typedef struct {
+    event_log_entry_t entries[EVENT_LOG_SIZE];
+    uint32_t head;           // Next position to write (producers)
+    uint32_t tail;           // Next position to drain (drain only)
+    uint32_t dropped;
+    event_log_sink_t sink;   // NULL: stdout
+    void* sink_ctx;
+} event_log_t;
+
+static event_log_t event_log;
+
+static const struct {
+    const char* name;
+    const char* format;  // Consumes the four args
+} event_log_formats[EVLOG_ID_COUNT] = {
+    [EVLOG_REG_WRITE]     = { "write",        "0x%08X = 0x%08X" },
+    [EVLOG_REG_READ]      = { "read",         "0x%08X = 0x%08X" },
+    [EVLOG_CORE_START]    = { "start",        "core %u" },
+    [EVLOG_CORE_STOP]     = { "stop",         "core %u" },
+    [EVLOG_JOB_LOAD]      = { "job",          "core %u job %u [0x%08X-0x%08X]" },
+    [EVLOG_DESC_POST]     = { "post",         "core %u %u descriptors at %u" },
+    [EVLOG_JOB_SWAP]      = { "swap",         "core %u chunk %u" },
+    [EVLOG_RANGE_DONE]    = { "range done",   "core %u" },
+    [EVLOG_GOLDEN_NONCE]  = { "GOLDEN NONCE", "core %u job %u nonce 0x%08X" },
+    [EVLOG_HW_ERROR]      = { "HARDWARE ERROR", "nonce 0x%08X does not meet target (%u bad / %u total)" },
+    [EVLOG_FIFO_OVERFLOW] = { "WARNING",      "core %u result FIFO overflow, golden nonces lost" },
+    [EVLOG_RESTART]       = { "restart",      "generation %u, older work flushed" },
+    [EVLOG_CLOCK_SET]     = { "clock",        "%u kHz -> %u kHz (%u bad of %u)" },
+};
+
+static inline uint64_t event_log_ticks(void) {
+#ifdef __linux__
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+#else
+    XTime now;
+    XTime_GetTime(&now);
+    return now;
+#endif
+}
+
+// Append one event; unused args are ignored by its format
+void event_log_append(uint32_t id, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3) {
+    uint32_t pos = __atomic_fetch_add(&event_log.head, 1, __ATOMIC_RELAXED);
+    event_log_entry_t* entry = &event_log.entries[pos & (EVENT_LOG_SIZE - 1)];
+    
+    __atomic_store_n(&entry->sequence, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    entry->id = id;
+    entry->ticks = event_log_ticks();
+    entry->args[0] = a0;
+    entry->args[1] = a1;
+    entry->args[2] = a2;
+    entry->args[3] = a3;
+    __atomic_store_n(&entry->sequence, pos + 1, __ATOMIC_RELEASE);
+}
+
+void event_log_set_sink(event_log_sink_t sink, void* ctx) {
+    event_log.sink = sink;
+    event_log.sink_ctx = ctx;
+}
+
+static void event_log_emit(const char* line) {
+    if (event_log.sink) {
+        event_log.sink(line, event_log.sink_ctx);
+    } else {
+        fputs(line, stdout);
+    }
+}
+
+// Format up to max entries to the sink and return how many were written.
+// One drain at a time; producers never wait for it.
+uint32_t event_log_drain(uint32_t max) {
+    event_log_t* log = &event_log;
+    uint32_t done = 0;
+    char line[160];
+    
+    while (done < max) {
+        uint32_t head = __atomic_load_n(&log->head, __ATOMIC_ACQUIRE);
+        uint32_t pos = log->tail;
+        if (head == pos) {
+            break;
+        }
+        if (head - pos > EVENT_LOG_SIZE) {
+            log->dropped += head - EVENT_LOG_SIZE - pos;
+            log->tail = pos = head - EVENT_LOG_SIZE;
+        }
+        
+        // Copy, then re-check the sequence: a lapping producer may have
+        // rewritten the slot meanwhile
+        event_log_entry_t* slot = &log->entries[pos & (EVENT_LOG_SIZE - 1)];
+        uint32_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        if (sequence == 0) {
+            break;  // Still being written
+        }
+        event_log_entry_t entry = *slot;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        log->tail = pos + 1;
+        if (sequence != pos + 1 || __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != sequence) {
+            log->dropped++;
+            continue;
+        }
+        
+        uint64_t ticks = entry.ticks;
+        int n = snprintf(line, sizeof(line), "[%llu.%06llu] ",
+                         (unsigned long long)(ticks / EVENT_LOG_TICKS_PER_SEC),
+                         (unsigned long long)((ticks % EVENT_LOG_TICKS_PER_SEC) * 1000000 /
+                                              EVENT_LOG_TICKS_PER_SEC));
+        if (entry.id < EVLOG_ID_COUNT && event_log_formats[entry.id].name) {
+            n += snprintf(line + n, sizeof(line) - n, "%s: ", event_log_formats[entry.id].name);
+            n += snprintf(line + n, sizeof(line) - n, event_log_formats[entry.id].format,
+                          entry.args[0], entry.args[1], entry.args[2], entry.args[3]);
+        } else {
+            n += snprintf(line + n, sizeof(line) - n, "event %u", entry.id);
+        }
+        if (n > (int)sizeof(line) - 2) {
+            n = (int)sizeof(line) - 2;
+        }
+        line[n] = '\n';
+        line[n + 1] = '\0';
+        event_log_emit(line);
+        done++;
+    }
+    
+    if (log->dropped) {
+        snprintf(line, sizeof(line), "[log] %u events dropped\n", log->dropped);
+        event_log_emit(line);
+        log->dropped = 0;
+    }
+    return done;
+}
+
+// Miner core instance and the slice of the nonce space it owns
+typedef struct {
+    uint32_t base_addr;
+    uint32_t nonce_start;
+    uint32_t nonce_end;  // Inclusive
+} miner_core_t;
+
+miner_core_t miner_cores[MINER_NUM_CORES] = {
+    { MINER_BASE_ADDR, 0x00000000, 0xFFFFFFFF }
+};
+uint32_t miner_core_count = 1;
+
+// Run-time settings, overridable by the headless configuration
+uint32_t miner_poll_interval_us = MINER_POLL_INTERVAL_US;
+uint32_t miner_core_clock_hz = MINER_CORE_CLOCK_HZ;
+
+// Core addressed by write_register()/read_register() and every helper
+// built on them; see select_core()
+static miner_core_t* miner_selected = &miner_cores[0];
+
+#ifdef MINER_USE_UIO
+// UIO device exposing the miner cores as map 0 (MINER_BASE_ADDR up to
+// the last core) and, with MINER_USE_JOB_TABLE, the job table as map 1
+#ifndef MINER_UIO_DEVICE
+#define MINER_UIO_DEVICE "/dev/uio0"
+#endif
+
+#ifndef MINER_UIO_MAP_SIZE
+#define MINER_UIO_MAP_SIZE (MINER_NUM_CORES * MINER_CORE_STRIDE)
+#endif
+
+static int miner_uio_fd = -1;
+static volatile uint8_t* miner_uio_regs = NULL;
+
+// Map a UIO region; map n lives at offset n pages of the device
+static void* miner_uio_map(uint32_t index, size_t size) {
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, miner_uio_fd,
+                     (off_t)index * sysconf(_SC_PAGESIZE));
+    return (map == MAP_FAILED) ? NULL : map;
+}
+
+static inline void miner_io_write32(uint32_t addr, uint32_t value) {
+    *(volatile uint32_t*)(miner_uio_regs + (addr - MINER_BASE_ADDR)) = value;
+}
+
+static inline uint32_t miner_io_read32(uint32_t addr) {
+    return *(volatile uint32_t*)(miner_uio_regs + (addr - MINER_BASE_ADDR));
+}
+#elif defined(MINER_USE_SIM)
+// Software-emulated cores, see the "Software-emulated miner" section
+static void sim_write32(uint32_t addr, uint32_t value);
+static uint32_t sim_read32(uint32_t addr);
+static int sim_start(void);
+
+static inline void miner_io_write32(uint32_t addr, uint32_t value) {
+    sim_write32(addr, value);
+}
+
+static inline uint32_t miner_io_read32(uint32_t addr) {
+    return sim_read32(addr);
+}
+#else
+static inline void miner_io_write32(uint32_t addr, uint32_t value) {
+    Xil_Out32(addr, value);
+}
+
+static inline uint32_t miner_io_read32(uint32_t addr) {
+    return Xil_In32(addr);
+}
+#endif
+
+#if defined(MINER_USE_UIO)
+#define MINER_BACKEND_NAME "uio"
+#elif defined(MINER_USE_SIM)
+#define MINER_BACKEND_NAME "sim"
+#else
+#define MINER_BACKEND_NAME "baremetal"
+#endif
+
+// Bring up the register backend. Returns 0 on success, -1 if the miner
+// registers cannot be reached.
+int miner_backend_init(void) {
+#ifdef MINER_USE_UIO
+    miner_uio_fd = open(MINER_UIO_DEVICE, O_RDWR | O_SYNC);
+    if (miner_uio_fd < 0) {
+        printf("Cannot open %s: %s\n", MINER_UIO_DEVICE, strerror(errno));
+        return -1;
+    }
+    miner_uio_regs = miner_uio_map(0, MINER_UIO_MAP_SIZE);
+    if (miner_uio_regs == NULL) {
+        printf("Cannot map miner registers: %s\n", strerror(errno));
+        close(miner_uio_fd);
+        miner_uio_fd = -1;
+        return -1;
+    }
+#elif defined(MINER_USE_SIM)
+    if (sim_start() != 0) {
+        printf("Cannot start the emulated cores\n");
+        return -1;
+    }
+#endif
+    return 0;
 }
 
-uint32_t read_register(uint32_t offset) {
-    uint32_t value = Xil_In32(MINER_BASE_ADDR + offset);
-    printf("Read: 0x%08X = 0x%08X\n", MINER_BASE_ADDR + offset, value);
+// Memory-mapped register access through the selected backend
+static inline void core_write_register(const miner_core_t* core, uint32_t offset, uint32_t value) {
+    miner_io_write32(core->base_addr + offset, value);
+    TRACE_EVENT(EVLOG_REG_WRITE, core->base_addr + offset, value, 0, 0);
+}
+
+static inline uint32_t core_read_register(const miner_core_t* core, uint32_t offset) {
+    uint32_t value = miner_io_read32(core->base_addr + offset);
+    TRACE_EVENT(EVLOG_REG_READ, core->base_addr + offset, value, 0, 0);
     return value;
 }
 
+static inline void write_register(uint32_t offset, uint32_t value) {
+    core_write_register(miner_selected, offset, value);
+}
+
+static inline uint32_t read_register(uint32_t offset) {
+    return core_read_register(miner_selected, offset);
+}
+
+// Direct the single-core helpers at one core
+void select_core(uint32_t index) {
+    miner_selected = &miner_cores[index];
+}
+
+// Split [start, end] into count near-equal disjoint slices and return
+// slice index (inclusive bounds)
+void partition_nonce_range(uint32_t start, uint32_t end, uint32_t count, uint32_t index,
+                           uint32_t* slice_start, uint32_t* slice_end) {
+    uint64_t span = (uint64_t)end - start + 1;
+    uint64_t base = span / count;
+    uint64_t extra = span % count;
+    uint64_t first = start + base * index + (index < extra ? index : extra);
+    uint64_t size = base + (index < extra ? 1 : 0);
+    
+    *slice_start = (uint32_t)first;
+    *slice_end = (uint32_t)(first + size - 1);
+}
+
+// Enumerate the miner cores and give each a disjoint slice of the full
+// nonce space
+void miner_cores_init(uint32_t count) {
+    static const uint32_t base_table[MINER_NUM_CORES] = MINER_CORE_BASE_ADDRS;
+    
+    if (count == 0 || count > MINER_NUM_CORES) {
+        count = MINER_NUM_CORES;
+    }
+    miner_core_count = count;
+    
+    for (uint32_t i = 0; i < count; i++) {
+        miner_cores[i].base_addr = base_table[i] ? base_table[i] :
+                                   MINER_BASE_ADDR + (i * MINER_CORE_STRIDE);
+        partition_nonce_range(0x00000000, 0xFFFFFFFF, count, i,
+                              &miner_cores[i].nonce_start, &miner_cores[i].nonce_end);
+    }
+    select_core(0);
+}
+
+// Adaptive status polling, used when no interrupt line is available.
+// Each core gets its own next-poll deadline from its measured hashrate:
+// polls close in as the active range nears its predicted end or a share
+// becomes likely, and back off to POLL_MAX_US otherwise. Cores that are
+// not due are not read at all. Until a rate is known cores are polled
+// every miner_poll_interval_us.
+#ifndef POLL_MIN_US
+#define POLL_MIN_US 50
+#endif
+#ifndef POLL_MAX_US
+#define POLL_MAX_US 50000
+#endif
+#ifndef POLL_SHARE_DIVISOR
+#define POLL_SHARE_DIVISOR 8  // Polls per expected share interval
+#endif
+
+typedef struct {
+    uint64_t range_nonces;        // Active range size, 0 = unknown
+    uint64_t next_nonces;         // Shadow range, taken over on JOB_SWAP
+    double hashes_per_share;      // 2^256 / target of the active job
+    double next_hashes_per_share;
+    double hashrate;              // H/s, 0 until measured
+    uint64_t start_us;            // When the active range started
+    uint64_t due_us;              // Next status read
+} poll_sched_t;
+
+static poll_sched_t poll_sched[MINER_NUM_CORES];
+
+// Expected hashes per share for a target (word 0 least significant)
+static double target_hashes_per_share(const uint32_t target[8]) {
+    double value = 0.0;
+    for (int i = 7; i >= 0; i--) {
+        value = value * 4294967296.0 + (double)target[i];
+    }
+    return 1.157920892373162e77 / (value + 1.0);  // 2^256
+}
+
+// Feed a hashrate measurement (H/s) for a core
+void poll_sched_rate(uint32_t core, double hashrate) {
+    poll_sched_t* s = &poll_sched[core];
+    if (hashrate > 0.0) {
+        s->hashrate = (s->hashrate > 0.0) ? (s->hashrate + hashrate) / 2 : hashrate;
+    }
+}
+
+// Microseconds until the core should next be read
+static uint32_t poll_sched_interval(const poll_sched_t* s, uint64_t now) {
+    if (s->hashrate <= 0.0 || s->range_nonces == 0) {
+        return miner_poll_interval_us;
+    }
+    
+    // Halve the predicted time left each poll, so detection of the range
+    // end lags by at most POLL_MIN_US once the prediction is reached
+    double elapsed = (double)(now - s->start_us);
+    double interval = ((double)s->range_nonces * 1e6 / s->hashrate - elapsed) / 2;
+    
+    // Several polls per expected share keep the result FIFO short
+    if (s->hashes_per_share > 0.0) {
+        double share_us = s->hashes_per_share * 1e6 / s->hashrate / POLL_SHARE_DIVISOR;
+        if (share_us < interval) {
+            interval = share_us;
+        }
+    }
+    if (interval < POLL_MIN_US) {
+        return POLL_MIN_US;
+    }
+    return (interval > POLL_MAX_US) ? POLL_MAX_US : (uint32_t)interval;
+}
+
+// Core has been read and reported events; plan the next read
+static void poll_sched_polled(uint32_t core, uint64_t now, uint32_t events) {
+    poll_sched_t* s = &poll_sched[core];
+    
+    if (events & MINER_EVENT_NOT_FOUND) {
+        // Whole range hashed: a (slightly low) rate sample
+        if (s->range_nonces && now > s->start_us) {
+            poll_sched_rate(core, (double)s->range_nonces * 1e6 / (double)(now - s->start_us));
+        }
+        s->range_nonces = 0;  // Idle until the next start
+    } else if (events & MINER_EVENT_JOB_SWAP) {
+        // Shadow job took over; job table chunks keep their size
+        if (s->next_nonces) {
+            s->range_nonces = s->next_nonces;
+            s->hashes_per_share = s->next_hashes_per_share;
+            s->next_nonces = 0;
+        }
+        s->start_us = now;
+    }
+    s->due_us = now + poll_sched_interval(s, now);
+}
+
+// Earliest deadline over all cores, relative to now
+static uint32_t poll_sched_next(uint64_t now) {
+    uint64_t due = now + POLL_MAX_US;
+    for (uint32_t i = 0; i < miner_core_count; i++) {
+        if (poll_sched[i].due_us < due) {
+            due = poll_sched[i].due_us;
+        }
+    }
+    return (due > now) ? (uint32_t)(due - now) : 0;
+}
+
+// Program the selected core's nonce range registers
+void write_nonce_range(uint32_t start, uint32_t end) {
+    write_register(CTRL_START_NONCE, start);
+    write_register(CTRL_END_NONCE, end);
+    poll_sched[miner_selected - miner_cores].range_nonces = (uint64_t)end - start + 1;
+}
+
+// Program the range that goes with the shadow job
+void write_next_nonce_range(uint32_t start, uint32_t end) {
+    write_register(CTRL_NEXT_START_NONCE, start);
+    write_register(CTRL_NEXT_END_NONCE, end);
+    poll_sched[miner_selected - miner_cores].next_nonces = (uint64_t)end - start + 1;
+}
+
 // Write MID_STATE to FPGA
 void write_mid_state(uint32_t* mid_state) {
-    printf("Writing MID_STATE...\n");
     for (int i = 0; i < 8; i++) {
         write_register(BANK_1_OFFSET + (i * 4), mid_state[i]);
-        printf("  MID_STATE[%d] = 0x%08X\n", i, mid_state[i]);
     }
 }
 
-// Write RESIDUAL_DATA to FPGA
-void write_residual_data(uint32_t* residual_data) {
-    printf("Writing RESIDUAL_DATA...\n");
-    for (int i = 0; i < 3; i++) {
-        write_register(BANK_2_OFFSET + (i * 4), residual_data[i]);
-        printf("  RESIDUAL_DATA[%d] = 0x%08X\n", i, residual_data[i]);
-    }
+// Write RESIDUAL_DATA to FPGA
+void write_residual_data(uint32_t* residual_data) {
+    for (int i = 0; i < 3; i++) {
+        write_register(BANK_2_OFFSET + (i * 4), residual_data[i]);
+    }
+}
+
+// Write TARGET to FPGA
+void write_target(uint32_t* target) {
+    for (int i = 0; i < 8; i++) {
+        write_register(BANK_3_OFFSET + (i * 4), target[i]);
+    }
+    poll_sched[miner_selected - miner_cores].hashes_per_share = target_hashes_per_share(target);
+}
+
+// Preload the next job into the shadow banks while the current job
+// keeps hashing
+void write_next_job(const mining_params_t* params) {
+    for (int i = 0; i < 8; i++) {
+        write_register(BANK_5_OFFSET + (i * 4), params->mid_state[i]);
+    }
+    for (int i = 0; i < 3; i++) {
+        write_register(BANK_6_OFFSET + (i * 4), params->residual_data[i]);
+    }
+    for (int i = 0; i < 8; i++) {
+        write_register(BANK_7_OFFSET + (i * 4), params->target[i]);
+    }
+    poll_sched[miner_selected - miner_cores].next_hashes_per_share = target_hashes_per_share(params->target);
+}
+
+// Fill a descriptor from a job and its nonce range
+void job_desc_init(miner_job_desc_t* desc, const mining_params_t* params,
+                   uint32_t job_id, uint32_t nonce_start, uint32_t nonce_end) {
+    memset(desc, 0, sizeof(*desc));
+    desc->params = *params;
+    desc->job_id = job_id;
+    desc->nonce_start = nonce_start;
+    desc->nonce_end = nonce_end;
+}
+
+// Commit the shadow banks (JOB_COMMIT_NOW or JOB_COMMIT_ON_ROLLOVER)
+void commit_next_job(uint32_t mode) {
+    write_register(CTRL_JOB_COMMIT, mode);
+}
+
+// Check whether a committed shadow job is still waiting to be swapped in
+int next_job_pending(void) {
+    return (read_register(STATUS_JOB_PENDING) & 0x1);
+}
+
+#ifdef MINER_USE_JOB_TABLE
+// Job table: each core owns a ring of JOB_TABLE_ENTRIES descriptors in a
+// BRAM behind an AXI BRAM controller. When its range runs out the core
+// fetches the next descriptor itself (raising JOB_SWAP), so the host
+// queues a batch with one burst copy and a single doorbell write instead
+// of 21 AXI-Lite writes per job.
+#ifndef MINER_JOB_TABLE_ADDR
+#ifdef XPAR_AXI_BRAM_CTRL_0_S_AXI_BASEADDR
+#define MINER_JOB_TABLE_ADDR XPAR_AXI_BRAM_CTRL_0_S_AXI_BASEADDR
+#else
+#define MINER_JOB_TABLE_ADDR 0x40000000
+#endif
+#endif
+
+#ifndef JOB_TABLE_ENTRIES
+#define JOB_TABLE_ENTRIES 32
+#endif
+
+// Descriptors written to each core's ring (mirrors CTRL_DESC_DOORBELL)
+static uint32_t job_table_head[MINER_NUM_CORES];
+
+// Order the descriptor stores before the doorbell write
+#ifdef __linux__
+#define JOB_TABLE_BARRIER() __sync_synchronize()
+#else
+#define JOB_TABLE_BARRIER() dsb()
+#endif
+
+#ifdef MINER_USE_UIO
+static miner_job_desc_t* job_table_base = NULL;  // UIO map 1
+#elif defined(MINER_USE_SIM)
+static miner_job_desc_t sim_job_table[MINER_NUM_CORES * JOB_TABLE_ENTRIES];
+static miner_job_desc_t* const job_table_base = sim_job_table;
+#else
+static miner_job_desc_t* const job_table_base = (miner_job_desc_t*)(uintptr_t)MINER_JOB_TABLE_ADDR;
+#endif
+
+static inline miner_job_desc_t* job_table_ring(uint32_t core) {
+    return job_table_base + core * JOB_TABLE_ENTRIES;
+}
+
+// Map the table as normal non-cacheable memory so descriptor copies
+// leave the CPU as AXI bursts, and sync the ring heads with the cores.
+// Returns 0 on success, -1 if the table cannot be mapped.
+int job_table_init(void) {
+    uint32_t bytes = miner_core_count * JOB_TABLE_ENTRIES * (uint32_t)sizeof(miner_job_desc_t);
+    
+#ifdef MINER_USE_UIO
+    job_table_base = miner_uio_map(1, bytes);
+    if (job_table_base == NULL) {
+        printf("Cannot map job table: %s\n", strerror(errno));
+        return -1;
+    }
+#elif !defined(__linux__)
+    for (uint32_t off = 0; off < bytes; off += 0x100000) {
+        Xil_SetTlbAttributes(MINER_JOB_TABLE_ADDR + off, NORM_NONCACHE);
+    }
+#else
+    (void)bytes;
+#endif
+    for (uint32_t i = 0; i < miner_core_count; i++) {
+        job_table_head[i] = core_read_register(&miner_cores[i], STATUS_DESC_FETCHED);
+        core_write_register(&miner_cores[i], CTRL_DESC_DOORBELL, job_table_head[i]);
+    }
+    return 0;
+}
+
+// Descriptor count of the selected core; descriptors numbered below it
+// have been fetched, the one before it is (or was) hashing
+uint32_t job_table_fetched(void) {
+    return read_register(STATUS_DESC_FETCHED);
+}
+
+// Descriptors the selected core's ring can still take
+uint32_t job_table_space(void) {
+    uint32_t index = (uint32_t)(miner_selected - miner_cores);
+    return JOB_TABLE_ENTRIES - (job_table_head[index] - job_table_fetched());
+}
+
+// Copy count descriptors into the selected core's ring and publish them
+// with one doorbell write. Returns how many were queued (bounded by the
+// free ring space).
+uint32_t job_table_post(const miner_job_desc_t* descs, uint32_t count) {
+    uint32_t index = (uint32_t)(miner_selected - miner_cores);
+    miner_job_desc_t* ring = job_table_ring(index);
+    uint32_t space = job_table_space();
+    uint32_t head = job_table_head[index];
+    
+    if (count > space) {
+        count = space;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    
+    // At most two contiguous copies, split where the ring wraps
+    uint32_t slot = head % JOB_TABLE_ENTRIES;
+    uint32_t first = JOB_TABLE_ENTRIES - slot;
+    if (first > count) {
+        first = count;
+    }
+    memcpy(&ring[slot], descs, first * sizeof(*descs));
+    memcpy(&ring[0], descs + first, (count - first) * sizeof(*descs));
+    
+    event_log_append(EVLOG_DESC_POST, index, count, head, 0);
+    JOB_TABLE_BARRIER();
+    job_table_head[index] = head + count;
+    write_register(CTRL_DESC_DOORBELL, job_table_head[index]);
+    return count;
+}
+#endif
+
+// Event callback invoked from the miner interrupt handler
+typedef void (*miner_event_callback_t)(uint32_t core, uint32_t events, void* ctx);
+
+static volatile uint32_t miner_pending_events[MINER_NUM_CORES];
+static int miner_irq_active = 0;
+
+// Read FOUND/NOT_FOUND status of one core as an event mask
+static inline uint32_t read_miner_events(const miner_core_t* core) {
+    uint32_t events = 0;
+    if (core_read_register(core, STATUS_FOUND) & 0x1) {
+        events |= MINER_EVENT_FOUND;
+    }
+    if (core_read_register(core, STATUS_NOT_FOUND) & 0x1) {
+        events |= MINER_EVENT_NOT_FOUND;
+    }
+    if (core_read_register(core, STATUS_JOB_SWAPPED) & 0x1) {
+        events |= MINER_EVENT_JOB_SWAP;
+    }
+    return events;
+}
+
+#if defined(MINER_USE_IRQ) || defined(MINER_USE_UIO)
+static miner_event_callback_t miner_event_callback = NULL;
+static void* miner_event_ctx = NULL;
+
+// The cores share one interrupt line, so scan them all, latch and
+// acknowledge their events, then notify the callback
+static void miner_latch_events(void) {
+    for (uint32_t i = 0; i < miner_core_count; i++) {
+        uint32_t events = read_miner_events(&miner_cores[i]);
+        if (!events) {
+            continue;
+        }
+        core_write_register(&miner_cores[i], CTRL_IRQ_ACK, events);
+        miner_pending_events[i] |= events;
+        if (miner_event_callback) {
+            miner_event_callback(i, events, miner_event_ctx);
+        }
+    }
+}
+#endif
+
+#ifdef MINER_USE_IRQ
+static XScuGic miner_gic;
+
+// GIC handler
+static void miner_irq_handler(void* ref) {
+    (void)ref;
+    miner_latch_events();
+}
+#endif
+
+#ifdef MINER_USE_UIO
+// Unmask the interrupt; the UIO driver masks it again each time it fires
+static int miner_uio_irq_arm(void) {
+    uint32_t enable = 1;
+    return (write(miner_uio_fd, &enable, sizeof(enable)) == sizeof(enable)) ? 0 : -1;
+}
+
+// Block on the UIO fd for up to timeout_us, latching events if the
+// interrupt fires
+static void miner_uio_wait_irq(uint32_t timeout_us) {
+    struct pollfd pfd = { miner_uio_fd, POLLIN, 0 };
+    uint32_t count;
+    
+    if (poll(&pfd, 1, (int)((timeout_us + 999) / 1000)) <= 0) {
+        return;
+    }
+    if (read(miner_uio_fd, &count, sizeof(count)) == sizeof(count)) {
+        miner_latch_events();
+    }
+    miner_uio_irq_arm();
+}
+#endif
+
+// Wait between event checks: on the UIO fd when its interrupt is active,
+// otherwise until the next core is due a poll. Returns the time waited in
+// microseconds.
+static uint32_t miner_wait_slice(uint32_t remaining_us) {
+#ifdef MINER_USE_UIO
+    if (miner_irq_active) {
+        uint64_t start = miner_time_us();
+        miner_uio_wait_irq(remaining_us);
+        return (uint32_t)(miner_time_us() - start) + 1;
+    }
+#endif
+    uint32_t slice = 10;
+    if (!miner_irq_active) {
+        slice = poll_sched_next(miner_time_us());
+        if (slice > remaining_us) {
+            slice = remaining_us;
+        }
+        if (slice == 0) {
+            slice = 1;
+        }
+    }
+    usleep(slice);
+    return slice;
+}
+
+// Connect the miner interrupt to the GIC, or to the UIO device under
+// Linux. Returns 0 when interrupts are active, -1 when the driver has to
+// fall back to status polling.
+int miner_irq_init(miner_event_callback_t callback, void* ctx) {
+#ifdef MINER_USE_UIO
+    miner_event_callback = callback;
+    miner_event_ctx = ctx;
+    for (uint32_t i = 0; i < miner_core_count; i++) {
+        core_write_register(&miner_cores[i], CTRL_IRQ_ACK, MINER_EVENT_ALL);
+        core_write_register(&miner_cores[i], CTRL_IRQ_ENABLE, MINER_EVENT_ALL);
+    }
+    if (miner_uio_irq_arm() != 0) {
+        return -1;  // No interrupt in the device tree node
+    }
+    miner_irq_active = 1;
+    return 0;
+#elif defined(MINER_USE_IRQ)
+    XScuGic_Config* config = XScuGic_LookupConfig(XPAR_SCUGIC_SINGLE_DEVICE_ID);
+    if (config == NULL) {
+        return -1;
+    }
+    if (XScuGic_CfgInitialize(&miner_gic, config, config->CpuBaseAddress) != XST_SUCCESS) {
+        return -1;
+    }
+    
+    miner_event_callback = callback;
+    miner_event_ctx = ctx;
+    
+    Xil_ExceptionInit();
+    Xil_ExceptionRegisterHandler(XIL_EXCEPTION_ID_INT,
+                                 (Xil_ExceptionHandler)XScuGic_InterruptHandler,
+                                 &miner_gic);
+    
+    // Rising-edge trigger, default priority
+    XScuGic_SetPriorityTriggerType(&miner_gic, MINER_IRQ_ID, 0xA0, 0x3);
+    if (XScuGic_Connect(&miner_gic, MINER_IRQ_ID,
+                        (Xil_InterruptHandler)miner_irq_handler, NULL) != XST_SUCCESS) {
+        return -1;
+    }
+    XScuGic_Enable(&miner_gic, MINER_IRQ_ID);
+    Xil_ExceptionEnable();
+    
+    for (uint32_t i = 0; i < miner_core_count; i++) {
+        core_write_register(&miner_cores[i], CTRL_IRQ_ACK, MINER_EVENT_ALL);
+        core_write_register(&miner_cores[i], CTRL_IRQ_ENABLE, MINER_EVENT_ALL);
+    }
+    miner_irq_active = 1;
+    return 0;
+#else
+    (void)callback;
+    (void)ctx;
+    return -1;
+#endif
+}
+
+// Drop any latched events of the selected core (called before a new
+// range starts)
+void miner_clear_events(void) {
+    uint32_t index = (uint32_t)(miner_selected - miner_cores);
+#ifdef MINER_USE_IRQ
+    if (miner_irq_active) {
+        XScuGic_Disable(&miner_gic, MINER_IRQ_ID);
+        write_register(CTRL_IRQ_ACK, MINER_EVENT_ALL);
+        miner_pending_events[index] = 0;
+        XScuGic_Enable(&miner_gic, MINER_IRQ_ID);
+        return;
+    }
+#endif
+    write_register(CTRL_IRQ_ACK, MINER_EVENT_ALL);
+    miner_pending_events[index] = 0;
+}
+
+// Take latched events of every core without waiting. core_events[i]
+// receives core i's mask; the return value is the union.
+uint32_t miner_take_core_events(uint32_t core_events[MINER_NUM_CORES]) {
+    uint32_t any = 0;
+    
+    if (!miner_irq_active) {
+        uint64_t now = miner_time_us();
+        for (uint32_t i = 0; i < miner_core_count; i++) {
+            // Events handed back by miner_wait_event() come first
+            core_events[i] = miner_pending_events[i];
+            miner_pending_events[i] = 0;
+            if (poll_sched[i].due_us <= now) {
+                uint32_t polled = read_miner_events(&miner_cores[i]);
+                poll_sched_polled(i, now, polled);
+                if (polled & MINER_EVENT_JOB_SWAP) {
+                    core_write_register(&miner_cores[i], CTRL_IRQ_ACK, MINER_EVENT_JOB_SWAP);
+                }
+                core_events[i] |= polled;
+            }
+            any |= core_events[i];
+        }
+        return any;
+    }
+    
+#ifdef MINER_USE_IRQ
+    XScuGic_Disable(&miner_gic, MINER_IRQ_ID);
+#endif
+    for (uint32_t i = 0; i < miner_core_count; i++) {
+        core_events[i] = miner_pending_events[i];
+        miner_pending_events[i] = 0;
+        any |= core_events[i];
+    }
+#ifdef MINER_USE_IRQ
+    XScuGic_Enable(&miner_gic, MINER_IRQ_ID);
+#endif
+    return any;
+}
+
+// Wait up to timeout_us for an event on any core. Fills core_events and
+// returns the union of all masks, or 0 on timeout. With interrupts active
+// this only checks latched flags (blocking on the UIO fd under Linux);
+// otherwise it polls the status registers.
+uint32_t miner_wait_core_events(uint32_t timeout_us, uint32_t core_events[MINER_NUM_CORES]) {
+    uint32_t waited = 0;
+    
+    while (1) {
+        uint32_t events = miner_take_core_events(core_events);
+        if (events) {
+            return events;
+        }
+        if (waited >= timeout_us) {
+            return 0;
+        }
+        waited += miner_wait_slice(timeout_us - waited);
+    }
+}
+
+// Put back events taken for every core but keep, so the next
+// miner_take_core_events() still sees them
+static void miner_return_core_events(const uint32_t core_events[MINER_NUM_CORES], uint32_t keep) {
+    uint32_t others = 0;
+    
+    for (uint32_t i = 0; i < miner_core_count; i++) {
+        if (i != keep) {
+            others |= core_events[i];
+        }
+    }
+    if (!others) {
+        return;
+    }
+#ifdef MINER_USE_IRQ
+    if (miner_irq_active) {
+        XScuGic_Disable(&miner_gic, MINER_IRQ_ID);
+    }
+#endif
+    for (uint32_t i = 0; i < miner_core_count; i++) {
+        if (i != keep) {
+            miner_pending_events[i] |= core_events[i];
+        }
+    }
+#ifdef MINER_USE_IRQ
+    if (miner_irq_active) {
+        XScuGic_Enable(&miner_gic, MINER_IRQ_ID);
+    }
+#endif
+}
+
+// Single-core form of miner_wait_core_events(): events of the selected
+// core. Events of the other cores stay latched for their next reader.
+uint32_t miner_wait_event(uint32_t timeout_us) {
+    uint32_t core_events[MINER_NUM_CORES];
+    uint32_t index = (uint32_t)(miner_selected - miner_cores);
+    uint32_t waited = 0;
+    
+    while (1) {
+        miner_take_core_events(core_events);
+        miner_return_core_events(core_events, index);
+        if (core_events[index] & MINER_EVENT_ALL) {
+            return core_events[index];
+        }
+        if (waited >= timeout_us) {
+            return 0;
+        }
+        waited += miner_wait_slice(timeout_us - waited);
+    }
+}
+
+// Switch to a new job without resetting the pipeline
+void switch_job(const mining_params_t* params) {
+    write_next_job(params);
+    commit_next_job(JOB_COMMIT_NOW);
+}
+
+// Start mining
+void start_mining(void) {
+    event_log_append(EVLOG_CORE_START, (uint32_t)(miner_selected - miner_cores), 0, 0, 0);
+    miner_clear_events();
+    write_register(CTRL_START, 1);
+    
+    poll_sched_t* sched = &poll_sched[miner_selected - miner_cores];
+    sched->start_us = miner_time_us();
+    sched->due_us = sched->start_us + poll_sched_interval(sched, sched->start_us);
+}
+
+// Stop mining
+void stop_mining(void) {
+    event_log_append(EVLOG_CORE_STOP, (uint32_t)(miner_selected - miner_cores), 0, 0, 0);
+    write_register(CTRL_SRST, 1);
+    usleep(1000); // Small delay
+    write_register(CTRL_SRST, 0);
+}
+
+// Stop every core
+void stop_all_cores(void) {
+    for (uint32_t i = 0; i < miner_core_count; i++) {
+        select_core(i);
+        stop_mining();
+    }
+    select_core(0);
+}
+
+// Check if golden nonce was found
+int check_found(void) {
+    uint32_t found = read_register(STATUS_FOUND);
+    return (found & 0x1);
+}
+
+// Get golden nonce if found
+uint32_t get_golden_nonce(void) {
+    return read_register(STATUS_GOLDEN_NONCE);
+}
+
+// Pop up to max golden nonces from the selected core's result FIFO;
+// returns how many were read
+uint32_t drain_golden_nonces(uint32_t* nonces, uint32_t max) {
+    uint32_t status = read_register(STATUS_RESULT_COUNT);
+    uint32_t count = status & RESULT_FIFO_COUNT_MASK;
+    
+    if (status & RESULT_FIFO_OVERFLOW) {
+        event_log_append(EVLOG_FIFO_OVERFLOW, (uint32_t)(miner_selected - miner_cores), 0, 0, 0);
+    }
+    if (count > max) {
+        count = max;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        nonces[i] = read_register(STATUS_RESULT_POP);
+    }
+    return count;
+}
+
+// Get current nonce being processed
+uint32_t get_current_nonce(void) {
+    write_register(CTRL_CURRENT_HASH_REQ, 1);
+    usleep(1000); // Small delay for CDC
+    write_register(CTRL_CURRENT_HASH_REQ, 0);
+    return read_register(STATUS_CURRENT_NONCE);
+}
+
+// Stop the selected core and return the nonce to resume from
+uint32_t pause_mining(void) {
+    uint32_t current_nonce = get_current_nonce();
+    stop_mining();
+    return current_nonce;
+}
+
+// Restart the selected core on a job at a bounded range, e.g. from the
+// position returned by pause_mining()
+void resume_mining(const mining_params_t* params, uint32_t start, uint32_t end) {
+    mining_params_t job = *params;
+    stop_mining();
+    write_mid_state(job.mid_state);
+    write_residual_data(job.residual_data);
+    write_target(job.target);
+    write_nonce_range(start, end);
+    start_mining();
+}
+
+// Print current mining status
+void print_mining_status(void) {
+    miner_core_t* selected = miner_selected;
+    
+    printf("=== Mining Status ===\n");
+    for (uint32_t i = 0; i < miner_core_count; i++) {
+        select_core(i);
+        uint32_t current_nonce = get_current_nonce();
+        uint32_t found = read_register(STATUS_FOUND);
+        uint32_t not_found = read_register(STATUS_NOT_FOUND);
+        
+        if (miner_core_count > 1) {
+            printf("Core %u [0x%08X-0x%08X]\n", i,
+                   miner_cores[i].nonce_start, miner_cores[i].nonce_end);
+        }
+        printf("Current Nonce: 0x%08X (%u)\n", current_nonce, current_nonce);
+        printf("Found: %s\n", found ? "YES" : "NO");
+        printf("Not Found: %s\n", not_found ? "YES" : "NO");
+        
+        if (found) {
+            uint32_t golden_nonce = get_golden_nonce();
+            printf("Golden Nonce: 0x%08X (%u)\n", golden_nonce, golden_nonce);
+        }
+    }
+    printf("===================\n");
+    miner_selected = selected;
+}
+
+// Very easy target for testing (will find nonces quickly)
+static const uint32_t test_easy_target[8] = {
+    0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF,
+    0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0x000000FF
+};
+
+// Set a very easy difficulty for testing (will find nonces quickly)
+void set_test_difficulty(void) {
+    uint32_t easy_target[8];
+    memcpy(easy_target, test_easy_target, sizeof(easy_target));
+    write_target(easy_target);
+    printf("Set test difficulty (very easy target)\n");
+}
+
+// Expand compact difficulty bits into a 256-bit target
+// (target = mantissa * 256^(exponent - 3), word 0 = least significant)
+void bits_to_target(uint32_t bits, uint32_t target[8]) {
+    uint32_t exp = (bits >> 24) & 0xFF;
+    uint32_t mantissa = bits & 0x007FFFFF;
+    
+    memset(target, 0, 8 * sizeof(uint32_t));
+    
+    // Sign bit set means a negative target, which nothing can meet
+    if (bits & 0x00800000) {
+        return;
+    }
+    
+    if (exp <= 3) {
+        target[0] = mantissa >> (8 * (3 - exp));
+        return;
+    }
+    
+    uint32_t shift = 8 * (exp - 3);
+    uint32_t word = shift / 32;
+    uint64_t value = (uint64_t)mantissa << (shift % 32);
+    
+    // Overflowing 256 bits saturates to the easiest possible target
+    if (word > 7 || (word == 7 && (value >> 32) != 0)) {
+        memset(target, 0xFF, 8 * sizeof(uint32_t));
+        return;
+    }
+    
+    target[word] = (uint32_t)value;
+    if (word < 7) {
+        target[word + 1] = (uint32_t)(value >> 32);
+    }
+}
+
+// Convert a pool share difficulty into a 256-bit target
+// (target = difficulty-1 target / difficulty)
+void difficulty_to_target(double difficulty, uint32_t target[8]) {
+    if (difficulty <= 0.0) {
+        memset(target, 0xFF, 8 * sizeof(uint32_t));
+        return;
+    }
+    
+    // Difficulty 1 target is 0xFFFF * 2^208
+    double remaining = 65535.0;
+    for (int i = 0; i < 208; i += 16) {
+        remaining *= 65536.0;
+    }
+    remaining /= difficulty;
+    
+    double scale = 1.0;
+    for (int i = 0; i < 7; i++) {
+        scale *= 4294967296.0;
+    }
+    
+    for (int i = 7; i >= 0; i--) {
+        double word = remaining / scale;
+        if (word >= 4294967295.0) {
+            target[i] = 0xFFFFFFFF;
+        } else {
+            target[i] = (uint32_t)word;
+        }
+        remaining -= (double)target[i] * scale;
+        if (remaining < 0.0) {
+            remaining = 0.0;
+        }
+        scale /= 4294967296.0;
+    }
+}
+
+// Set real Bitcoin difficulty (will rarely find nonces)
+void set_real_difficulty(void) {
+    uint32_t real_target[8];
+    bits_to_target(BTC_MAINNET_BITS, real_target);
+    write_target(real_target);
+    printf("Set real Bitcoin difficulty (bits 0x%08X)\n", BTC_MAINNET_BITS);
+}
+
+// Set the target for an arbitrary pool share difficulty
+void set_share_difficulty(double difficulty) {
+    uint32_t share_target[8];
+    difficulty_to_target(difficulty, share_target);
+    write_target(share_target);
+    printf("Set share difficulty %.3f\n", difficulty);
+}
+
+// SHA-256 round constants
+static const uint32_t sha256_k[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+
+// SHA-256 initial hash value
+static const uint32_t sha256_iv[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+    0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+#define SHA256_CH(x, y, z)  ((z) ^ ((x) & ((y) ^ (z))))
+#define SHA256_MAJ(x, y, z) (((x) & (y)) | ((z) & ((x) | (y))))
+#define SHA256_EP0(x)  (ROTR32(x, 2) ^ ROTR32(x, 13) ^ ROTR32(x, 22))
+#define SHA256_EP1(x)  (ROTR32(x, 6) ^ ROTR32(x, 11) ^ ROTR32(x, 25))
+#define SHA256_SIG0(x) (ROTR32(x, 7) ^ ROTR32(x, 18) ^ ((x) >> 3))
+#define SHA256_SIG1(x) (ROTR32(x, 17) ^ ROTR32(x, 19) ^ ((x) >> 10))
+
+// Message schedule kept as a rolling 16-word window
+#define SHA256_W(i) ((i) < 16 ? w[(i)] : \
+    (w[(i) & 15] += SHA256_SIG1(w[((i) - 2) & 15]) + w[((i) - 7) & 15] + \
+                    SHA256_SIG0(w[((i) - 15) & 15])))
+
+// One round; callers rotate the variable names instead of shuffling registers
+#define SHA256_ROUND(a, b, c, d, e, f, g, h, i) do { \
+    uint32_t t1 = h + SHA256_EP1(e) + SHA256_CH(e, f, g) + sha256_k[i] + SHA256_W(i); \
+    d += t1; \
+    h = t1 + SHA256_EP0(a) + SHA256_MAJ(a, b, c); \
+} while (0)
+
+#define SHA256_8ROUNDS(i) do { \
+    SHA256_ROUND(a, b, c, d, e, f, g, h, (i) + 0); \
+    SHA256_ROUND(h, a, b, c, d, e, f, g, (i) + 1); \
+    SHA256_ROUND(g, h, a, b, c, d, e, f, (i) + 2); \
+    SHA256_ROUND(f, g, h, a, b, c, d, e, (i) + 3); \
+    SHA256_ROUND(e, f, g, h, a, b, c, d, (i) + 4); \
+    SHA256_ROUND(d, e, f, g, h, a, b, c, (i) + 5); \
+    SHA256_ROUND(c, d, e, f, g, h, a, b, (i) + 6); \
+    SHA256_ROUND(b, c, d, e, f, g, h, a, (i) + 7); \
+} while (0)
+
+// Big-endian / little-endian helpers for header serialization
+static inline uint32_t load_be32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline void store_be32(uint8_t* p, uint32_t value) {
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)(value >> 16);
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t)value;
+}
+
+static inline void store_le32(uint8_t* p, uint32_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+// Integer fields of block_header_wire_t are little-endian; these are
+// no-ops on the Cortex-A9
+static inline uint32_t host_to_le32(uint32_t value) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap32(value);
+#else
+    return value;
+#endif
+}
+
+static inline uint32_t le32_to_host(uint32_t value) {
+    return host_to_le32(value);
+}
+
+// SHA-256 compression function on one 512-bit block of big-endian words.
+// Fully unrolled so all round constants and schedule indices are resolved
+// at compile time.
+void sha256_transform(uint32_t state[8], const uint32_t data[16]) {
+    uint32_t w[16];
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+    memcpy(w, data, sizeof(w));
+
+    SHA256_8ROUNDS(0);
+    SHA256_8ROUNDS(8);
+    SHA256_8ROUNDS(16);
+    SHA256_8ROUNDS(24);
+    SHA256_8ROUNDS(32);
+    SHA256_8ROUNDS(40);
+    SHA256_8ROUNDS(48);
+    SHA256_8ROUNDS(56);
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+// Streaming SHA-256 over arbitrary byte strings (coinbase, merkle nodes)
+typedef struct {
+    uint32_t state[8];
+    uint8_t buffer[64];
+    uint64_t length;  // Bytes hashed so far
+} sha256_ctx_t;
+
+static void sha256_block(uint32_t state[8], const uint8_t block[64]) {
+    uint32_t data[16];
+    for (int i = 0; i < 16; i++) {
+        data[i] = load_be32(block + (i * 4));
+    }
+    sha256_transform(state, data);
+}
+
+void sha256_init(sha256_ctx_t* ctx) {
+    memcpy(ctx->state, sha256_iv, sizeof(sha256_iv));
+    ctx->length = 0;
+}
+
+void sha256_update(sha256_ctx_t* ctx, const uint8_t* data, size_t len) {
+    size_t used = (size_t)(ctx->length & 63);
+    ctx->length += len;
+    
+    if (used) {
+        size_t fill = 64 - used;
+        if (len < fill) {
+            memcpy(ctx->buffer + used, data, len);
+            return;
+        }
+        memcpy(ctx->buffer + used, data, fill);
+        sha256_block(ctx->state, ctx->buffer);
+        data += fill;
+        len -= fill;
+    }
+    
+    while (len >= 64) {
+        sha256_block(ctx->state, data);
+        data += 64;
+        len -= 64;
+    }
+    memcpy(ctx->buffer, data, len);
+}
+
+void sha256_final(sha256_ctx_t* ctx, uint8_t digest[32]) {
+    uint64_t bit_length = ctx->length * 8;
+    size_t used = (size_t)(ctx->length & 63);
+    
+    ctx->buffer[used++] = 0x80;
+    if (used > 56) {
+        memset(ctx->buffer + used, 0, 64 - used);
+        sha256_block(ctx->state, ctx->buffer);
+        used = 0;
+    }
+    memset(ctx->buffer + used, 0, 56 - used);
+    store_be32(ctx->buffer + 56, (uint32_t)(bit_length >> 32));
+    store_be32(ctx->buffer + 60, (uint32_t)bit_length);
+    sha256_block(ctx->state, ctx->buffer);
+    
+    for (int i = 0; i < 8; i++) {
+        store_be32(digest + (i * 4), ctx->state[i]);
+    }
+}
+
+// Bitcoin double SHA-256
+void sha256d(const uint8_t* data, size_t len, uint8_t digest[32]) {
+    sha256_ctx_t ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, data, len);
+    sha256_final(&ctx, digest);
+    
+    sha256_init(&ctx);
+    sha256_update(&ctx, digest, 32);
+    sha256_final(&ctx, digest);
+}
+
+// Multi-lane SHA-256: four independent compressions per call. Layout is
+// word-major (state[word][lane], data[word][lane]) so each word of all four
+// lanes loads as one NEON vector.
+#if SHA256_USE_NEON
+#define V_ROTR(x, n) vorrq_u32(vshrq_n_u32((x), (n)), vshlq_n_u32((x), 32 - (n)))
+#define V_CH(x, y, z)  vbslq_u32((x), (y), (z))
+#define V_MAJ(x, y, z) vbslq_u32(veorq_u32((x), (y)), (z), (y))
+#define V_EP0(x)  veorq_u32(veorq_u32(V_ROTR(x, 2), V_ROTR(x, 13)), V_ROTR(x, 22))
+#define V_EP1(x)  veorq_u32(veorq_u32(V_ROTR(x, 6), V_ROTR(x, 11)), V_ROTR(x, 25))
+#define V_SIG0(x) veorq_u32(veorq_u32(V_ROTR(x, 7), V_ROTR(x, 18)), vshrq_n_u32((x), 3))
+#define V_SIG1(x) veorq_u32(veorq_u32(V_ROTR(x, 17), V_ROTR(x, 19)), vshrq_n_u32((x), 10))
+
+static inline uint32x4_t sha256_w_x4(uint32x4_t w[16], int i) {
+    if (i >= 16) {
+        w[i & 15] = vaddq_u32(vaddq_u32(w[i & 15], V_SIG1(w[(i - 2) & 15])),
+                              vaddq_u32(w[(i - 7) & 15], V_SIG0(w[(i - 15) & 15])));
+    }
+    return w[i & 15];
+}
+
+#define V_ROUND(a, b, c, d, e, f, g, h, i) do { \
+    uint32x4_t t1 = vaddq_u32(vaddq_u32(h, V_EP1(e)), \
+                              vaddq_u32(V_CH(e, f, g), vdupq_n_u32(sha256_k[i]))); \
+    t1 = vaddq_u32(t1, sha256_w_x4(w, (i))); \
+    d = vaddq_u32(d, t1); \
+    h = vaddq_u32(t1, vaddq_u32(V_EP0(a), V_MAJ(a, b, c))); \
+} while (0)
+
+#define V_8ROUNDS(i) do { \
+    V_ROUND(a, b, c, d, e, f, g, h, (i) + 0); \
+    V_ROUND(h, a, b, c, d, e, f, g, (i) + 1); \
+    V_ROUND(g, h, a, b, c, d, e, f, (i) + 2); \
+    V_ROUND(f, g, h, a, b, c, d, e, (i) + 3); \
+    V_ROUND(e, f, g, h, a, b, c, d, (i) + 4); \
+    V_ROUND(d, e, f, g, h, a, b, c, (i) + 5); \
+    V_ROUND(c, d, e, f, g, h, a, b, (i) + 6); \
+    V_ROUND(b, c, d, e, f, g, h, a, (i) + 7); \
+} while (0)
+
+void sha256_transform_x4(uint32_t state[8][4], const uint32_t data[16][4]) {
+    uint32x4_t w[16];
+    for (int i = 0; i < 16; i++) {
+        w[i] = vld1q_u32(data[i]);
+    }
+    
+    uint32x4_t a = vld1q_u32(state[0]), b = vld1q_u32(state[1]);
+    uint32x4_t c = vld1q_u32(state[2]), d = vld1q_u32(state[3]);
+    uint32x4_t e = vld1q_u32(state[4]), f = vld1q_u32(state[5]);
+    uint32x4_t g = vld1q_u32(state[6]), h = vld1q_u32(state[7]);
+    
+    V_8ROUNDS(0);
+    V_8ROUNDS(8);
+    V_8ROUNDS(16);
+    V_8ROUNDS(24);
+    V_8ROUNDS(32);
+    V_8ROUNDS(40);
+    V_8ROUNDS(48);
+    V_8ROUNDS(56);
+    
+    vst1q_u32(state[0], vaddq_u32(vld1q_u32(state[0]), a));
+    vst1q_u32(state[1], vaddq_u32(vld1q_u32(state[1]), b));
+    vst1q_u32(state[2], vaddq_u32(vld1q_u32(state[2]), c));
+    vst1q_u32(state[3], vaddq_u32(vld1q_u32(state[3]), d));
+    vst1q_u32(state[4], vaddq_u32(vld1q_u32(state[4]), e));
+    vst1q_u32(state[5], vaddq_u32(vld1q_u32(state[5]), f));
+    vst1q_u32(state[6], vaddq_u32(vld1q_u32(state[6]), g));
+    vst1q_u32(state[7], vaddq_u32(vld1q_u32(state[7]), h));
+}
+#else
+// Scalar fallback: one lane at a time through the unrolled kernel
+void sha256_transform_x4(uint32_t state[8][4], const uint32_t data[16][4]) {
+    for (int lane = 0; lane < 4; lane++) {
+        uint32_t lane_state[8];
+        uint32_t lane_data[16];
+        for (int i = 0; i < 8; i++) {
+            lane_state[i] = state[i][lane];
+        }
+        for (int i = 0; i < 16; i++) {
+            lane_data[i] = data[i][lane];
+        }
+        sha256_transform(lane_state, lane_data);
+        for (int i = 0; i < 8; i++) {
+            state[i][lane] = lane_state[i];
+        }
+    }
+}
+#endif
+
+// Reset all four lanes to the SHA-256 initial hash value
+static void sha256_init_x4(uint32_t state[8][4]) {
+    for (int i = 0; i < 8; i++) {
+        for (int lane = 0; lane < 4; lane++) {
+            state[i][lane] = sha256_iv[i];
+        }
+    }
+}
+
+// Second SHA-256 of sha256d over four 32-byte first hashes, in place
+static void sha256_hash32_x4(uint32_t state[8][4]) {
+    uint32_t data[16][4];
+    
+    memcpy(data, state, 8 * sizeof(data[0]));
+    for (int lane = 0; lane < 4; lane++) {
+        data[8][lane] = 0x80000000;
+        for (int i = 9; i < 15; i++) {
+            data[i][lane] = 0;
+        }
+        data[15][lane] = 256;
+    }
+    sha256_init_x4(state);
+    sha256_transform_x4(state, data);
+}
+
+// Double SHA-256 of four 64-byte messages given as words; data is
+// clobbered
+static void sha256d_block_x4(uint32_t state[8][4], uint32_t data[16][4]) {
+    sha256_init_x4(state);
+    sha256_transform_x4(state, data);
+    
+    // Padding block of a 64-byte message
+    for (int lane = 0; lane < 4; lane++) {
+        data[0][lane] = 0x80000000;
+        for (int i = 1; i < 15; i++) {
+            data[i][lane] = 0;
+        }
+        data[15][lane] = 512;
+    }
+    sha256_transform_x4(state, data);
+    sha256_hash32_x4(state);
+}
+
+// Four double SHA-256 hashes of 64-byte messages (merkle tree nodes)
+void sha256d_64_x4(const uint8_t* in[4], uint8_t* out[4]) {
+    uint32_t state[8][4];
+    uint32_t data[16][4];
+    
+    for (int i = 0; i < 16; i++) {
+        for (int lane = 0; lane < 4; lane++) {
+            data[i][lane] = load_be32(in[lane] + (i * 4));
+        }
+    }
+    sha256d_block_x4(state, data);
+    
+    for (int lane = 0; lane < 4; lane++) {
+        for (int i = 0; i < 8; i++) {
+            store_be32(out[lane] + (i * 4), state[i][lane]);
+        }
+    }
+}
+
+// Convert a header to its wire image
+void header_to_wire(const bitcoin_block_header_t* header, block_header_wire_t* wire) {
+    wire->version = host_to_le32(header->version);
+    memcpy(wire->prev_block, header->prev_block, 32);
+    memcpy(wire->merkle_root, header->merkle_root, 32);
+    wire->timestamp = host_to_le32(header->timestamp);
+    wire->bits = host_to_le32(header->bits);
+    wire->nonce = host_to_le32(header->nonce);
+}
+
+// Convert a wire image back to host-order fields
+void header_from_wire(const block_header_wire_t* wire, bitcoin_block_header_t* header) {
+    header->version = le32_to_host(wire->version);
+    memcpy(header->prev_block, wire->prev_block, 32);
+    memcpy(header->merkle_root, wire->merkle_root, 32);
+    header->timestamp = le32_to_host(wire->timestamp);
+    header->bits = le32_to_host(wire->bits);
+    header->nonce = le32_to_host(wire->nonce);
+}
+
+// Serialize header into the 80-byte wire format (integers little-endian,
+// hashes in internal byte order)
+void serialize_block_header(const bitcoin_block_header_t* header, uint8_t out[80]) {
+    block_header_wire_t wire;
+    header_to_wire(header, &wire);
+    memcpy(out, &wire, sizeof(wire));
+}
+
+// Prepare mining parameters straight from a wire header
+void process_wire_header(const block_header_wire_t* wire, mining_params_t* params) {
+    // SHA-256 reads the message as big-endian words
+    const uint8_t* raw = (const uint8_t*)wire;
+    uint32_t words[20];
+    for (int i = 0; i < 20; i++) {
+        words[i] = load_be32(raw + (i * 4));
+    }
+    
+    // Mid-state: compression of the first 64 bytes of the header
+    memcpy(params->mid_state, sha256_iv, sizeof(sha256_iv));
+    sha256_transform(params->mid_state, words);
+    
+    // Residual data: the rest of the second chunk except the nonce,
+    // which the FPGA iterates itself
+    params->residual_data[0] = words[16];  // Last 4 bytes of merkle root
+    params->residual_data[1] = words[17];  // Timestamp
+    params->residual_data[2] = words[18];  // Bits
+    
+    // Convert difficulty bits to target
+    bits_to_target(le32_to_host(wire->bits), params->target);
+    
+    TRACE_PRINTF("Mining parameters prepared\n");
+}
+
+// Process Bitcoin block header and prepare mining parameters
+void process_block_header(bitcoin_block_header_t* header, mining_params_t* params) {
+    TRACE_PRINTF("Processing block header...\n");
+    TRACE_PRINTF("Version: 0x%08X\n", header->version);
+    TRACE_PRINTF("Timestamp: %u\n", header->timestamp);
+    TRACE_PRINTF("Bits: 0x%08X\n", header->bits);
+    TRACE_PRINTF("Nonce: 0x%08X\n", header->nonce);
+    
+    block_header_wire_t wire;
+    header_to_wire(header, &wire);
+    process_wire_header(&wire, params);
+}
+
+// Golden nonce verification results, for tracking the fabric error rate
+typedef struct {
+    uint32_t valid;
+    uint32_t invalid;
+} hw_error_stats_t;
+
+hw_error_stats_t miner_hw_stats = { 0, 0 };
+
+// Recompute the block hash for a reported nonce from the job's midstate
+// and residual words (the nonce as it appears in the header, the same
+// value STATUS_GOLDEN_NONCE reports). hash receives the final SHA-256
+// state words; may be NULL.
+void hash_job_nonce(const mining_params_t* params, uint32_t nonce, uint32_t hash[8]) {
+    uint32_t state[8];
+    uint32_t data[16] = {
+        params->residual_data[0], params->residual_data[1], params->residual_data[2],
+        __builtin_bswap32(nonce),  // Header nonce is little-endian on the wire
+        0x80000000, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 640  // 80-byte message
+    };
+    
+    memcpy(state, params->mid_state, sizeof(state));
+    sha256_transform(state, data);
+    
+    // Second SHA-256 over the 32-byte first hash
+    memcpy(data, state, sizeof(state));
+    data[8] = 0x80000000;
+    memset(&data[9], 0, 6 * sizeof(uint32_t));
+    data[15] = 256;
+    memcpy(hash, sha256_iv, sizeof(sha256_iv));
+    sha256_transform(hash, data);
+}
+
+// Batched hash_job_nonce() for four nonces of the same job
+void hash_job_nonces_x4(const mining_params_t* params, const uint32_t nonce[4],
+                        uint32_t hash[4][8]) {
+    uint32_t state[8][4];
+    uint32_t data[16][4];
+    
+    for (int lane = 0; lane < 4; lane++) {
+        for (int i = 0; i < 8; i++) {
+            state[i][lane] = params->mid_state[i];
+        }
+        data[0][lane] = params->residual_data[0];
+        data[1][lane] = params->residual_data[1];
+        data[2][lane] = params->residual_data[2];
+        data[3][lane] = __builtin_bswap32(nonce[lane]);
+        data[4][lane] = 0x80000000;
+        for (int i = 5; i < 15; i++) {
+            data[i][lane] = 0;
+        }
+        data[15][lane] = 640;
+    }
+    sha256_transform_x4(state, data);
+    sha256_hash32_x4(state);
+    
+    for (int lane = 0; lane < 4; lane++) {
+        for (int i = 0; i < 8; i++) {
+            hash[lane][i] = state[i][lane];
+        }
+    }
+}
+
+// Compare a block hash (SHA-256 state words) against a target. The hash
+// is read as a little-endian 256-bit number, so word i of it is the
+// byte-swapped state word i. Returns 1 if hash <= target.
+int hash_meets_target(const uint32_t hash[8], const uint32_t target[8]) {
+    for (int i = 7; i >= 0; i--) {
+        uint32_t word = __builtin_bswap32(hash[i]);
+        if (word != target[i]) {
+            return word < target[i];
+        }
+    }
+    return 1;
+}
+
+// Check whether a nonce solves a job, without touching the statistics
+int job_nonce_valid(const mining_params_t* params, uint32_t nonce) {
+    uint32_t hash[8];
+    hash_job_nonce(params, nonce, hash);
+    return hash_meets_target(hash, params->target);
+}
+
+// Count a verified (or rejected) golden nonce in the error statistics
+void record_golden_nonce(uint32_t nonce, int valid) {
+    if (valid) {
+        miner_hw_stats.valid++;
+        return;
+    }
+    
+    miner_hw_stats.invalid++;
+    event_log_append(EVLOG_HW_ERROR, nonce, miner_hw_stats.invalid,
+                     miner_hw_stats.valid + miner_hw_stats.invalid, 0);
+}
+
+// Check a golden nonce reported by the FPGA before it is submitted.
+// Returns 1 if it is a real solution for the job, 0 (and counts a
+// hardware error) otherwise.
+int verify_golden_nonce(const mining_params_t* params, uint32_t nonce) {
+    int valid = job_nonce_valid(params, nonce);
+    record_golden_nonce(nonce, valid);
+    return valid;
+}
+
+// Check a batch of nonces of one job four at a time; valid[i] is set to
+// 1 or 0. Statistics are left to the caller.
+void check_golden_nonces(const mining_params_t* params, const uint32_t* nonces,
+                         uint32_t count, int* valid) {
+    for (uint32_t i = 0; i < count; i += 4) {
+        uint32_t lane_nonces[4];
+        uint32_t hash[4][8];
+        
+        // Pad the last group by repeating its first nonce
+        for (uint32_t lane = 0; lane < 4; lane++) {
+            lane_nonces[lane] = nonces[(i + lane < count) ? i + lane : i];
+        }
+        hash_job_nonces_x4(params, lane_nonces, hash);
+        for (uint32_t lane = 0; lane < 4 && i + lane < count; lane++) {
+            valid[i + lane] = hash_meets_target(hash[lane], params->target);
+        }
+    }
+}
+
+// Fraction of reported nonces that failed verification
+double hw_error_rate(void) {
+    uint32_t total = miner_hw_stats.valid + miner_hw_stats.invalid;
+    return total ? (double)miner_hw_stats.invalid / (double)total : 0.0;
+}
+
+#ifdef MINER_USE_SIM
+// Software-emulated miner: models the register map of each core in host
+// memory. Time-driven: every register access moves the addressed core's
+// nonce counter on by what it would have hashed at MINER_SIM_HASHRATE
+// since its last access, so the driver's polling and sleeps behave as
+// against the fabric. The accesses never hash: a background thread per
+// core scans the active range with the host SHA-256 kernel, ahead of
+// the counter where the host is fast enough, and each hit enters the
+// result FIFO once the counter passes its nonce. On a host slower than
+// the emulated cores the scan falls behind and an unscanned tail of more
+// than MINER_SIM_TAIL_SCAN nonces yields no hits. No interrupt line; the
+// driver polls.
+#ifndef MINER_SIM_HASHRATE
+#define MINER_SIM_HASHRATE 1000000  // Emulated H/s per core at MINER_CORE_CLOCK_HZ
+#endif
+
+// Emulated timing limit: above it a growing share of results is corrupt
+#ifndef MINER_SIM_FMAX_HZ
+#define MINER_SIM_FMAX_HZ 150000000
+#endif
+
+// Nonces the scan thread hashes between looks at the core
+#ifndef MINER_SIM_SCAN_BATCH
+#define MINER_SIM_SCAN_BATCH 4096
+#endif
+// Unscanned tail a range may leave with, hashed by the access itself so
+// short ranges keep their hits; longer tails are given up
+#ifndef MINER_SIM_TAIL_SCAN
+#define MINER_SIM_TAIL_SCAN 64
+#endif
+#define SIM_SCAN_IDLE_US 100
+#define SIM_HIT_DEPTH    16  // Hits scanned ahead of the counter
+
+typedef struct {
+    mining_params_t active;  // Banks 1-3
+    mining_params_t shadow;  // Banks 5-7
+    uint32_t start_nonce;
+    uint32_t end_nonce;
+    uint32_t next_start_nonce;
+    uint32_t next_end_nonce;
+    uint64_t nonce;          // Next nonce to hash
+    uint64_t scan_nonce;     // Next nonce the scan thread checks
+    uint32_t scan_epoch;     // Bumped whenever the active range changes
+    uint32_t hits[SIM_HIT_DEPTH];  // Scanned, counter not there yet
+    uint32_t hit_count;
+    int running;
+    int reset;               // SRST held
+    int not_found;
+    int swapped;
+    int commit_pending;
+    uint32_t irq_enable;
+    uint32_t golden_nonce;
+    uint32_t current_nonce;  // Latched by CTRL_CURRENT_HASH_REQ
+    uint32_t results[RESULT_FIFO_DEPTH];
+    uint32_t result_head;
+    uint32_t result_count;
+    int result_overflow;
+    uint32_t desc_doorbell;
+    uint32_t desc_fetched;
+    uint64_t hashes;         // Since START
+    uint64_t start_us;
+    uint64_t idle_us;
+    uint64_t last_us;
+} sim_core_t;
+
+static sim_core_t sim_cores[MINER_NUM_CORES];
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;  // Accesses vs. scan threads
+static uint32_t sim_clock_hz = MINER_CORE_CLOCK_HZ;  // See miner_set_core_clock()
+static uint32_t sim_error_seed = 1;
+
+// Load the range that was committed with the shadow banks, or the next
+// job table descriptor; returns 0 if there is nothing to swap to
+static int sim_next_job(sim_core_t* core, uint32_t index) {
+    if (core->commit_pending) {
+        core->active = core->shadow;
+        core->start_nonce = core->next_start_nonce;
+        core->end_nonce = core->next_end_nonce;
+        core->commit_pending = 0;
+        return 1;
+    }
+#ifdef MINER_USE_JOB_TABLE
+    if (core->desc_fetched != core->desc_doorbell) {
+        const miner_job_desc_t* desc =
+            &sim_job_table[index * JOB_TABLE_ENTRIES + core->desc_fetched % JOB_TABLE_ENTRIES];
+        core->active = desc->params;
+        core->start_nonce = desc->nonce_start;
+        core->end_nonce = desc->nonce_end;
+        core->desc_fetched++;
+        return 1;
+    }
+#else
+    (void)index;
+#endif
+    return 0;
+}
+
+static void sim_push_result(sim_core_t* core, uint32_t nonce) {
+    // Past fmax, corrupt results at a rate rising 10% per 1% overclock
+    if (sim_clock_hz > MINER_SIM_FMAX_HZ) {
+        uint32_t over = (uint32_t)(((uint64_t)sim_clock_hz - MINER_SIM_FMAX_HZ) * 1000 / MINER_SIM_FMAX_HZ);
+        sim_error_seed = sim_error_seed * 1103515245 + 12345;
+        if ((sim_error_seed >> 16) % 100 < over) {
+            nonce ^= 0x00010000;
+        }
+    }
+    if (core->result_count == RESULT_FIFO_DEPTH) {
+        core->result_overflow = 1;
+        return;
+    }
+    core->results[(core->result_head + core->result_count) % RESULT_FIFO_DEPTH] = nonce;
+    core->result_count++;
+    core->golden_nonce = nonce;
+}
+
+// Hash count nonces from first, stopping at SIM_HIT_DEPTH hits. Returns
+// the nonces covered.
+static uint64_t sim_scan(const mining_params_t* params, uint64_t first, uint64_t count,
+                         uint32_t* hits, uint32_t* hit_count) {
+    uint64_t scanned = 0;
+    
+    *hit_count = 0;
+    while (scanned < count && *hit_count < SIM_HIT_DEPTH) {
+        uint32_t nonces[4];
+        uint32_t hash[4][8];
+        uint64_t left = count - scanned;
+        uint32_t lanes = (left < 4) ? (uint32_t)left : 4;
+        
+        for (uint32_t lane = 0; lane < 4; lane++) {
+            nonces[lane] = (uint32_t)(first + scanned) + (lane < lanes ? lane : 0);
+        }
+        hash_job_nonces_x4(params, nonces, hash);
+        for (uint32_t lane = 0; lane < lanes && *hit_count < SIM_HIT_DEPTH; lane++) {
+            if (hash_meets_target(hash[lane], params->target)) {
+                hits[(*hit_count)++] = nonces[lane];
+            }
+        }
+        scanned += lanes;
+    }
+    if (*hit_count == SIM_HIT_DEPTH) {
+        scanned = (uint64_t)hits[SIM_HIT_DEPTH - 1] - first + 1;
+    }
+    return scanned;
+}
+
+// Start the counter and the scan over the active range
+static void sim_load_range(sim_core_t* core) {
+    core->nonce = core->start_nonce;
+    core->scan_nonce = core->start_nonce;
+    core->scan_epoch++;
+    core->hit_count = 0;
+}
+
+// Pass scanned hits below the counter on to the result FIFO
+static void sim_release_hits(sim_core_t* core, uint64_t counter) {
+    uint32_t n = 0;
+    
+    while (n < core->hit_count && core->hits[n] < counter) {
+        sim_push_result(core, core->hits[n++]);
+    }
+    core->hit_count -= n;
+    memmove(core->hits, core->hits + n, core->hit_count * sizeof(core->hits[0]));
+}
+
+// Move the counter on by the nonces the core owes since its last access
+static void sim_advance(sim_core_t* core, uint32_t index) {
+    uint64_t now = miner_time_us();
+    uint64_t budget = (now - core->last_us) * MINER_SIM_HASHRATE / 1000000 *
+                      sim_clock_hz / MINER_CORE_CLOCK_HZ;
+    
+    if (!core->running) {
+        core->idle_us += now - core->last_us;
+        core->last_us = now;
+        return;
+    }
+    if (budget == 0) {
+        return;  // Keep last_us so short intervals add up
+    }
+    core->last_us = now;
+    
+    while (budget > 0 && core->running) {
+        uint64_t left = (uint64_t)core->end_nonce - core->nonce + 1;
+        uint64_t step = (budget < left) ? budget : left;
+        
+        core->nonce += step;
+        core->hashes += step;
+        budget -= step;
+        sim_release_hits(core, core->nonce);
+        
+        if (core->nonce > core->end_nonce) {
+            uint64_t tail = (uint64_t)core->end_nonce - core->scan_nonce + 1;
+            if (core->scan_nonce <= core->end_nonce && tail <= MINER_SIM_TAIL_SCAN) {
+                uint32_t hits[SIM_HIT_DEPTH];
+                uint32_t hit_count;
+                sim_scan(&core->active, core->scan_nonce, tail, hits, &hit_count);
+                for (uint32_t i = 0; i < hit_count; i++) {
+                    sim_push_result(core, hits[i]);
+                }
+            }
+            if (sim_next_job(core, index)) {
+                sim_load_range(core);
+                core->swapped = 1;
+            } else {
+                core->running = 0;
+                core->not_found = 1;
+                core->scan_epoch++;
+            }
+        }
+    }
+}
+
+// Scan thread of one core: hashes the active range in batches without
+// holding the lock, and keeps the hits until the counter gets there
+static void* sim_scan_main(void* arg) {
+    sim_core_t* core = &sim_cores[(uintptr_t)arg];
+    
+    for (;;) {
+        pthread_mutex_lock(&sim_lock);
+        uint32_t epoch = core->scan_epoch;
+        uint64_t first = core->scan_nonce;
+        uint64_t count = 0;
+        mining_params_t params = core->active;
+        if (core->running && core->hit_count < SIM_HIT_DEPTH && first <= core->end_nonce) {
+            count = (uint64_t)core->end_nonce - first + 1;
+            if (count > MINER_SIM_SCAN_BATCH) {
+                count = MINER_SIM_SCAN_BATCH;
+            }
+        }
+        pthread_mutex_unlock(&sim_lock);
+        if (count == 0) {
+            usleep(SIM_SCAN_IDLE_US);
+            continue;
+        }
+        
+        uint32_t hits[SIM_HIT_DEPTH];
+        uint32_t hit_count;
+        uint64_t scanned = sim_scan(&params, first, count, hits, &hit_count);
+        
+        pthread_mutex_lock(&sim_lock);
+        if (core->scan_epoch == epoch) {
+            uint32_t room = SIM_HIT_DEPTH - core->hit_count;
+            if (hit_count > room) {
+                // Resume after the last hit that fits
+                hit_count = room;
+                scanned = (uint64_t)hits[hit_count - 1] - first + 1;
+            }
+            memcpy(core->hits + core->hit_count, hits, hit_count * sizeof(hits[0]));
+            core->hit_count += hit_count;
+            core->scan_nonce = first + scanned;
+            sim_release_hits(core, core->nonce);
+        }
+        pthread_mutex_unlock(&sim_lock);
+    }
+    return NULL;
+}
+
+// Start the scan thread of every emulated core
+static int sim_start(void) {
+    for (uintptr_t i = 0; i < MINER_NUM_CORES; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, sim_scan_main, (void*)i) != 0) {
+            return -1;
+        }
+        pthread_detach(thread);
+    }
+    return 0;
+}
+
+// Decode an address into core and register offset
+static sim_core_t* sim_decode(uint32_t addr, uint32_t* index, uint32_t* offset) {
+    *index = (addr - MINER_BASE_ADDR) / MINER_CORE_STRIDE;
+    *offset = (addr - MINER_BASE_ADDR) % MINER_CORE_STRIDE;
+    if (*index >= MINER_NUM_CORES) {
+        *index = 0;
+        *offset = 0xFFFFFFFF;  // Unmapped
+    }
+    return &sim_cores[*index];
+}
+
+// Word of the bank at base, or NULL if offset is outside it
+static uint32_t* sim_bank_word(mining_params_t* params, uint32_t offset, uint32_t base) {
+    uint32_t word;
+    
+    if (offset < base + BANK_1_OFFSET || offset >= base + BANK_3_OFFSET + 0x100) {
+        return NULL;
+    }
+    if (offset >= base + BANK_3_OFFSET) {
+        word = (offset - base - BANK_3_OFFSET) / 4;
+        return (word < 8) ? &params->target[word] : NULL;
+    }
+    if (offset >= base + BANK_2_OFFSET) {
+        word = (offset - base - BANK_2_OFFSET) / 4;
+        return (word < 3) ? &params->residual_data[word] : NULL;
+    }
+    word = (offset - base - BANK_1_OFFSET) / 4;
+    return (word < 8) ? &params->mid_state[word] : NULL;
+}
+
+static void sim_write32_locked(uint32_t addr, uint32_t value) {
+    uint32_t index, offset;
+    sim_core_t* core = sim_decode(addr, &index, &offset);
+    uint32_t* word;
+    
+    sim_advance(core, index);
+    
+    if ((word = sim_bank_word(&core->active, offset, 0)) != NULL ||
+        (word = sim_bank_word(&core->shadow, offset, SHADOW_BANK_DELTA)) != NULL) {
+        *word = value;
+        return;
+    }
+    
+    switch (offset) {
+    case CTRL_SRST:
+        core->reset = value & 0x1;
+        if (core->reset) {
+            core->running = 0;
+            core->not_found = 0;
+            core->swapped = 0;
+            core->commit_pending = 0;
+            core->result_count = 0;
+            core->result_overflow = 0;
+            core->desc_fetched = core->desc_doorbell;
+            core->scan_epoch++;
+            core->hit_count = 0;
+        }
+        break;
+    case CTRL_START:
+        if ((value & 0x1) && !core->reset) {
+            core->running = 1;
+            core->not_found = 0;
+            sim_load_range(core);
+            core->hashes = 0;
+            core->idle_us = 0;
+            core->start_us = core->last_us = miner_time_us();
+        }
+        break;
+    case CTRL_JOB_COMMIT:
+        if (value & JOB_COMMIT_NOW) {
+            core->commit_pending = 1;
+            sim_next_job(core, index);
+            sim_load_range(core);
+            core->swapped = 1;
+        } else if (value & JOB_COMMIT_ON_ROLLOVER) {
+            core->commit_pending = 1;
+        }
+        break;
+    case CTRL_CURRENT_HASH_REQ:
+        if (value & 0x1) {
+            core->current_nonce = (uint32_t)core->nonce;
+        }
+        break;
+    case CTRL_IRQ_ENABLE:
+        core->irq_enable = value;
+        break;
+    case CTRL_IRQ_ACK:
+        if (value & MINER_EVENT_NOT_FOUND) {
+            core->not_found = 0;
+        }
+        if (value & MINER_EVENT_JOB_SWAP) {
+            core->swapped = 0;
+        }
+        break;  // FOUND stays set while the result FIFO holds nonces
+    case CTRL_START_NONCE:
+        core->start_nonce = value;
+        break;
+    case CTRL_END_NONCE:
+        core->end_nonce = value;
+        break;
+    case CTRL_NEXT_START_NONCE:
+        core->next_start_nonce = value;
+        break;
+    case CTRL_NEXT_END_NONCE:
+        core->next_end_nonce = value;
+        break;
+    case CTRL_DESC_DOORBELL:
+        core->desc_doorbell = value;  // Fetched at the next rollover
+        break;
+    default:
+        break;
+    }
+}
+
+static uint32_t sim_read32_locked(uint32_t addr) {
+    uint32_t index, offset;
+    sim_core_t* core = sim_decode(addr, &index, &offset);
+    uint32_t* word;
+    uint32_t value;
+    
+    sim_advance(core, index);
+    
+    if ((word = sim_bank_word(&core->active, offset, 0)) != NULL ||
+        (word = sim_bank_word(&core->shadow, offset, SHADOW_BANK_DELTA)) != NULL) {
+        return *word;
+    }
+    
+    switch (offset) {
+    case STATUS_FOUND:
+        return core->result_count > 0;
+    case STATUS_NOT_FOUND:
+        return core->not_found;
+    case STATUS_GOLDEN_NONCE:
+        return core->golden_nonce;
+    case STATUS_CURRENT_NONCE:
+        return core->current_nonce;
+    case STATUS_JOB_PENDING:
+        return core->commit_pending;
+    case STATUS_JOB_SWAPPED:
+        return core->swapped;
+    case STATUS_RESULT_COUNT:
+        value = core->result_count | (core->result_overflow ? RESULT_FIFO_OVERFLOW : 0);
+        core->result_overflow = 0;
+        return value;
+    case STATUS_RESULT_POP:
+        if (core->result_count == 0) {
+            return 0;
+        }
+        value = core->results[core->result_head];
+        core->result_head = (core->result_head + 1) % RESULT_FIFO_DEPTH;
+        core->result_count--;
+        return value;
+    case STATUS_HASH_COUNT:
+        return (uint32_t)core->hashes;
+    case STATUS_CYCLE_COUNT:
+        return (uint32_t)((core->last_us - core->start_us) * (sim_clock_hz / 1000000));
+    case STATUS_IDLE_CYCLES:
+        return (uint32_t)(core->idle_us * (sim_clock_hz / 1000000));
+    case STATUS_DESC_FETCHED:
+        return core->desc_fetched;
+    default:
+        return 0;
+    }
+}
+
+static void sim_write32(uint32_t addr, uint32_t value) {
+    pthread_mutex_lock(&sim_lock);
+    sim_write32_locked(addr, value);
+    pthread_mutex_unlock(&sim_lock);
+}
+
+static uint32_t sim_read32(uint32_t addr) {
+    pthread_mutex_lock(&sim_lock);
+    uint32_t value = sim_read32_locked(addr);
+    pthread_mutex_unlock(&sim_lock);
+    return value;
+}
+#endif
+
+// Miner core clock control. Bare metal reprograms the FCLK_CLK0 divisors
+// in the SLCR, or an AXI Clocking Wizard with -DMINER_CLKWIZ_BASE; under
+// PetaLinux the devcfg driver's fclk sysfs node takes the rate. The
+// simulator models the clock (and its failure above MINER_SIM_FMAX_HZ).
+#define SLCR_BASE            0xF8000000
+#define SLCR_LOCK            0x004
+#define SLCR_UNLOCK          0x008
+#define SLCR_FPGA0_CLK_CTRL  0x170  // [25:20] DIVISOR1, [13:8] DIVISOR0
+#define SLCR_LOCK_KEY        0x767B
+#define SLCR_UNLOCK_KEY      0xDF0D
+
+#ifndef MINER_FCLK_PLL_HZ
+#define MINER_FCLK_PLL_HZ 1000000000  // PLL selected for FCLK_CLK0 (IO PLL)
+#endif
+
+// AXI Clocking Wizard dynamic reconfiguration registers
+#define CLKWIZ_STATUS        0x004  // Bit 0: locked
+#define CLKWIZ_CLKOUT0       0x208  // [7:0] divide, [17:8] fraction (1/1000)
+#define CLKWIZ_LOAD          0x25C  // Bit 0 load, bit 1 use register values
+
+#ifndef MINER_CLKWIZ_VCO_HZ
+#define MINER_CLKWIZ_VCO_HZ 1000000000
+#endif
+
+#ifndef MINER_FCLK_SYSFS
+#define MINER_FCLK_SYSFS "/sys/devices/soc0/amba/f8007000.devcfg/fclk/fclk0/set_rate"
+#endif
+
+// XADC temperature: IIO under Linux, an AXI XADC Wizard on bare metal
+#ifndef MINER_XADC_IIO
+#define MINER_XADC_IIO "/sys/bus/iio/devices/iio:device0"
+#endif
+#if !defined(MINER_XADC_BASE) && defined(XPAR_XADC_WIZ_0_BASEADDR)
+#define MINER_XADC_BASE XPAR_XADC_WIZ_0_BASEADDR
+#endif
+#define XADC_TEMPERATURE 0x200  // [15:4] = 12-bit reading
+
+#if defined(__linux__) && !defined(MINER_USE_SIM)
+static int read_sysfs_value(const char* path, double* value) {
+    FILE* file = fopen(path, "r");
+    int ok;
+    
+    if (!file) {
+        return -1;
+    }
+    ok = (fscanf(file, "%lf", value) == 1);
+    fclose(file);
+    return ok ? 0 : -1;
+}
+#endif
+
+// Program the core clock as close to hz as the source allows without
+// going over. Returns the clock now running, or 0 if the clock cannot be
+// changed on this build.
+uint32_t miner_set_core_clock(uint32_t hz) {
+#if defined(MINER_USE_SIM)
+    sim_clock_hz = hz;
+    return hz;
+#elif defined(__linux__)
+    FILE* file = fopen(MINER_FCLK_SYSFS, "w");
+    double rate;
+    
+    if (!file) {
+        return 0;
+    }
+    fprintf(file, "%u\n", hz);
+    if (fclose(file) != 0 || read_sysfs_value(MINER_FCLK_SYSFS, &rate) != 0) {
+        return 0;
+    }
+    return (uint32_t)rate;
+#elif defined(MINER_CLKWIZ_BASE)
+    // Output divide in 1/8 steps, rounded up so the clock never overshoots
+    uint32_t divide = (uint32_t)(((uint64_t)MINER_CLKWIZ_VCO_HZ * 1000 + hz - 1) / hz);
+    divide = (divide + 124) / 125 * 125;
+    if (divide < 2000) {
+        divide = 2000;
+    } else if (divide > 128000) {
+        divide = 128000;
+    }
+    Xil_Out32(MINER_CLKWIZ_BASE + CLKWIZ_CLKOUT0, (divide / 1000) | ((divide % 1000) << 8));
+    Xil_Out32(MINER_CLKWIZ_BASE + CLKWIZ_LOAD, 0x3);
+    for (int i = 0; i < 1000 && !(Xil_In32(MINER_CLKWIZ_BASE + CLKWIZ_STATUS) & 0x1); i++) {
+        usleep(10);
+    }
+    return (uint32_t)((uint64_t)MINER_CLKWIZ_VCO_HZ * 1000 / divide);
+#else
+    // Fastest DIVISOR0 x DIVISOR1 (1-63 each) not above hz
+    uint32_t best = 0, best_d0 = 0, best_d1 = 0;
+    for (uint32_t d0 = 1; d0 < 64; d0++) {
+        for (uint32_t d1 = 1; d1 < 64; d1++) {
+            uint32_t f = MINER_FCLK_PLL_HZ / (d0 * d1);
+            if (f <= hz && f > best) {
+                best = f;
+                best_d0 = d0;
+                best_d1 = d1;
+            }
+        }
+    }
+    if (best == 0) {
+        return 0;
+    }
+    uint32_t ctrl = Xil_In32(SLCR_BASE + SLCR_FPGA0_CLK_CTRL);
+    ctrl = (ctrl & ~((0x3Fu << 20) | (0x3Fu << 8))) | (best_d1 << 20) | (best_d0 << 8);
+    Xil_Out32(SLCR_BASE + SLCR_UNLOCK, SLCR_UNLOCK_KEY);
+    Xil_Out32(SLCR_BASE + SLCR_FPGA0_CLK_CTRL, ctrl);
+    Xil_Out32(SLCR_BASE + SLCR_LOCK, SLCR_LOCK_KEY);
+    return best;
+#endif
+}
+
+// Die temperature in degrees C. Returns 0, or -1 without an XADC.
+int miner_read_temperature(double* celsius) {
+#if defined(MINER_USE_SIM)
+    // Warms with the clock: 40 C at 100 MHz, +0.25 C per MHz
+    *celsius = 40.0 + ((double)sim_clock_hz - 100e6) * 0.25e-6;
+    return 0;
+#elif defined(__linux__)
+    double raw, offset = 0.0, scale;
+    if (read_sysfs_value(MINER_XADC_IIO "/in_temp0_raw", &raw) != 0 ||
+        read_sysfs_value(MINER_XADC_IIO "/in_temp0_scale", &scale) != 0) {
+        return -1;
+    }
+    read_sysfs_value(MINER_XADC_IIO "/in_temp0_offset", &offset);
+    *celsius = (raw + offset) * scale / 1000.0;  // scale is mC per LSB
+    return 0;
+#elif defined(MINER_XADC_BASE)
+    uint32_t code = (Xil_In32(MINER_XADC_BASE + XADC_TEMPERATURE) >> 4) & 0xFFF;
+    *celsius = code * 503.975 / 4096.0 - 273.15;
+    return 0;
+#else
+    (void)celsius;
+    return -1;
+#endif
+}
+
+// Clock tuning: raise the core clock a step at a time while host checks
+// of the golden nonces find no bad ones, back off once they do or the die
+// runs hot. A clock that produced errors is not tried again. Each
+// decision waits for TUNE_MIN_NONCES verified nonces, so a quiet period
+// never counts as clean.
+#ifndef TUNE_STEP_HZ
+#define TUNE_STEP_HZ 5000000
+#endif
+#ifndef TUNE_MIN_HZ
+#define TUNE_MIN_HZ 50000000
+#endif
+#ifndef TUNE_MAX_HZ
+#define TUNE_MAX_HZ 250000000
+#endif
+#ifndef TUNE_MIN_NONCES
+#define TUNE_MIN_NONCES 32
+#endif
+#ifndef TUNE_MAX_ERROR_RATE
+#define TUNE_MAX_ERROR_RATE 0.01  // Bad share of verified nonces tolerated
+#endif
+#ifndef TUNE_MAX_TEMP_C
+#define TUNE_MAX_TEMP_C 85.0
+#endif
+#ifndef TUNE_TEMP_MARGIN_C
+#define TUNE_TEMP_MARGIN_C 5.0    // Only step up this far below the limit
+#endif
+
+typedef struct {
+    int enabled;
+    uint32_t clock_hz;      // Programmed clock
+    uint32_t ceiling_hz;    // Highest clock still worth trying
+    uint32_t stable_hz;     // Highest clock that passed a clean window
+    int settling;           // Window after a change, may hold old-clock results
+    uint32_t base_valid;    // miner_hw_stats at the window start
+    uint32_t base_invalid;
+} clock_tuner_t;
+
+clock_tuner_t miner_clock_tuner;
+
+static void clock_tune_apply(clock_tuner_t* tuner, uint32_t hz, uint32_t bad, uint32_t total) {
+    uint32_t set = miner_set_core_clock(hz);
+    
+    if (set != 0 && set != tuner->clock_hz) {
+        event_log_append(EVLOG_CLOCK_SET, tuner->clock_hz / 1000, set / 1000, bad, total);
+        tuner->clock_hz = set;
+        miner_core_clock_hz = set;
+        tuner->settling = 1;
+    }
+    tuner->base_valid = miner_hw_stats.valid;
+    tuner->base_invalid = miner_hw_stats.invalid;
+}
+
+// Start tuning from the configured clock. Returns -1 if the clock is
+// not adjustable on this build.
+int clock_tune_init(clock_tuner_t* tuner) {
+    memset(tuner, 0, sizeof(*tuner));
+    tuner->clock_hz = miner_set_core_clock(miner_core_clock_hz);
+    if (tuner->clock_hz == 0) {
+        return -1;
+    }
+    miner_core_clock_hz = tuner->clock_hz;
+    tuner->ceiling_hz = TUNE_MAX_HZ;
+    tuner->stable_hz = TUNE_MIN_HZ;
+    tuner->base_valid = miner_hw_stats.valid;
+    tuner->base_invalid = miner_hw_stats.invalid;
+    tuner->enabled = 1;
+    return 0;
+}
+
+// Periodic tuning decision (from the mining loop)
+void clock_tune_step(clock_tuner_t* tuner) {
+    uint32_t bad = miner_hw_stats.invalid - tuner->base_invalid;
+    uint32_t total = miner_hw_stats.valid - tuner->base_valid + bad;
+    uint32_t clock = tuner->clock_hz;
+    double celsius;
+    int have_temp = (miner_read_temperature(&celsius) == 0);
+    
+    if (tuner->settling) {
+        // Results still queued from the previous clock would be misjudged
+        tuner->settling = 0;
+        tuner->base_valid = miner_hw_stats.valid;
+        tuner->base_invalid = miner_hw_stats.invalid;
+        return;
+    }
+    if (have_temp && celsius >= TUNE_MAX_TEMP_C) {
+        // Too hot: step down, but the clock itself is not to blame
+        if (clock - TUNE_STEP_HZ >= TUNE_MIN_HZ) {
+            clock_tune_apply(tuner, clock - TUNE_STEP_HZ, bad, total);
+        }
+    } else if (bad > 0 && bad > total * TUNE_MAX_ERROR_RATE) {
+        // Failing clock: never come back to it, drop to the last good one
+        tuner->ceiling_hz = clock - TUNE_STEP_HZ;
+        if (tuner->stable_hz > tuner->ceiling_hz) {
+            tuner->stable_hz = tuner->ceiling_hz;
+        }
+        clock_tune_apply(tuner, tuner->stable_hz, bad, total);
+    } else if (total >= TUNE_MIN_NONCES) {
+        // Clean window: this clock is good, try the next one
+        uint32_t next = clock + TUNE_STEP_HZ;
+        tuner->stable_hz = clock;
+        if (next <= tuner->ceiling_hz &&
+            (!have_temp || celsius < TUNE_MAX_TEMP_C - TUNE_TEMP_MARGIN_C)) {
+            clock_tune_apply(tuner, next, bad, total);
+        } else {
+            clock_tune_apply(tuner, clock, bad, total);
+        }
+    }
+}
+
+// Telemetry sampling and summary periods
+#ifndef TELEMETRY_SAMPLE_US
+#define TELEMETRY_SAMPLE_US 1000000
+#endif
+#ifndef TELEMETRY_REPORT_US
+#define TELEMETRY_REPORT_US 10000000
+#endif
+#define TELEMETRY_EWMA_ALPHA 0.2
+
+// Per-core hashrate tracking
+typedef struct {
+    uint64_t hashes;          // Hashes completed over the whole run
+    uint64_t chunk_base;      // Hashes from chunks finished before the current one
+    uint32_t last_counter;    // Last STATUS_HASH_COUNT reading
+    uint64_t last_hashes;     // hashes at the previous sample
+    uint64_t last_sample_us;
+    uint64_t idle_since_us;   // Non-zero while the core has no work
+    uint64_t idle_us;         // Host-observed time without work
+    double hashrate;          // Instantaneous, H/s
+    double hashrate_ewma;     // Smoothed, H/s
+} core_telemetry_t;
+
+// Pool verdicts for the most recent work templates (pool jobs)
+#ifndef TELEMETRY_JOB_SLOTS
+#define TELEMETRY_JOB_SLOTS 4
+#endif
+
+typedef struct {
+    uint32_t template_id;
+    uint32_t accepted;
+    uint32_t rejected;
+    int used;
+} job_telemetry_t;
+
+// Driver-wide performance counters
+typedef struct {
+    core_telemetry_t cores[MINER_NUM_CORES];
+    job_telemetry_t jobs[TELEMETRY_JOB_SLOTS];  // template_id % TELEMETRY_JOB_SLOTS
+    uint64_t start_us;
+    uint64_t last_report_us;
+    uint32_t jobs_loaded;     // Chunks written to active or shadow banks
+    double job_load_us;       // Last chunk load latency
+    double job_load_us_ewma;
+    double job_load_us_max;
+    uint32_t shares_found;    // Verified golden nonces
+    uint32_t shares_stale;    // Verified, but for an aborted generation
+    uint32_t shares_accepted; // Pool verdicts (when a pool reports them)
+    uint32_t shares_rejected;
+} miner_telemetry_t;
+
+miner_telemetry_t miner_telemetry;
+
+void telemetry_init(void) {
+    memset(&miner_telemetry, 0, sizeof(miner_telemetry));
+    miner_telemetry.start_us = miner_time_us();
+    miner_telemetry.last_report_us = miner_telemetry.start_us;
+    for (uint32_t i = 0; i < MINER_NUM_CORES; i++) {
+        miner_telemetry.cores[i].last_sample_us = miner_telemetry.start_us;
+        miner_telemetry.cores[i].idle_since_us = miner_telemetry.start_us;
+    }
+}
+
+static inline double ewma(double average, double sample) {
+    return (average == 0.0) ? sample :
+           average + TELEMETRY_EWMA_ALPHA * (sample - average);
+}
+
+// Record the latency of one chunk load (register writes to go)
+void telemetry_job_loaded(uint64_t elapsed_us) {
+    miner_telemetry_t* t = &miner_telemetry;
+    t->jobs_loaded++;
+    t->job_load_us = (double)elapsed_us;
+    t->job_load_us_ewma = ewma(t->job_load_us_ewma, t->job_load_us);
+    if (t->job_load_us > t->job_load_us_max) {
+        t->job_load_us_max = t->job_load_us;
+    }
+}
+
+// Pool verdict on a share of work template template_id
+void telemetry_share_result(uint32_t template_id, int accepted) {
+    job_telemetry_t* j = &miner_telemetry.jobs[template_id % TELEMETRY_JOB_SLOTS];
+    if (!j->used || j->template_id != template_id) {
+        memset(j, 0, sizeof(*j));
+        j->template_id = template_id;
+        j->used = 1;
+    }
+    if (accepted) {
+        j->accepted++;
+        miner_telemetry.shares_accepted++;
+    } else {
+        j->rejected++;
+        miner_telemetry.shares_rejected++;
+    }
+}
+
+// Core state changes seen by the feeder
+void telemetry_core_started(uint32_t core) {
+    core_telemetry_t* c = &miner_telemetry.cores[core];
+    if (c->idle_since_us) {
+        c->idle_us += miner_time_us() - c->idle_since_us;
+        c->idle_since_us = 0;
+    }
+    c->last_counter = 0;  // START clears the hardware counter
+}
+
+void telemetry_core_idle(uint32_t core) {
+    core_telemetry_t* c = &miner_telemetry.cores[core];
+    if (!c->idle_since_us) {
+        c->idle_since_us = miner_time_us();
+    }
+}
+
+// A core finished a chunk of chunk_hashes nonces
+void telemetry_chunk_done(uint32_t core, uint64_t chunk_hashes) {
+    core_telemetry_t* c = &miner_telemetry.cores[core];
+    c->chunk_base += chunk_hashes;
+    if (c->hashes < c->chunk_base) {
+        c->hashes = c->chunk_base;
+    }
+}
+
+// A core's chunk was abandoned part-way; keep the progress sampled so far
+void telemetry_chunk_abandoned(uint32_t core) {
+    core_telemetry_t* c = &miner_telemetry.cores[core];
+    c->chunk_base = c->hashes;
+}
+
+// Sample the selected core. chunk_start is the first nonce of the chunk
+// it is hashing (only used without hardware counters).
+void telemetry_sample_core(uint32_t core, uint32_t chunk_start) {
+    core_telemetry_t* c = &miner_telemetry.cores[core];
+    uint64_t now = miner_time_us();
+    
+#ifdef MINER_HAS_PERF_COUNTERS
+    (void)chunk_start;
+    uint32_t counter = read_register(STATUS_HASH_COUNT);
+    c->hashes += (uint32_t)(counter - c->last_counter);
+    c->last_counter = counter;
+#else
+    uint64_t progress = c->chunk_base + (uint32_t)(get_current_nonce() - chunk_start);
+    if (progress > c->hashes) {
+        c->hashes = progress;
+    }
+#endif
+    
+    uint64_t elapsed = now - c->last_sample_us;
+    if (elapsed > 0) {
+        c->hashrate = (double)(c->hashes - c->last_hashes) * 1e6 / (double)elapsed;
+        c->hashrate_ewma = ewma(c->hashrate_ewma, c->hashrate);
+        poll_sched_rate(core, c->hashrate_ewma);
+    }
+    c->last_hashes = c->hashes;
+    c->last_sample_us = now;
+}
+
+// Combined smoothed hashrate of all cores, H/s
+double telemetry_total_hashrate(void) {
+    double total = 0.0;
+    for (uint32_t i = 0; i < miner_core_count; i++) {
+        total += miner_telemetry.cores[i].hashrate_ewma;
+    }
+    return total;
+}
+
+// Print a compact summary line per core plus a totals line
+void telemetry_report(void) {
+    miner_telemetry_t* t = &miner_telemetry;
+    uint64_t now = miner_time_us();
+    double uptime = (double)(now - t->start_us) / 1e6;
+    
+    for (uint32_t i = 0; i < miner_core_count; i++) {
+        core_telemetry_t* c = &t->cores[i];
+        uint64_t idle = c->idle_us + (c->idle_since_us ? now - c->idle_since_us : 0);
+        printf("[telemetry] core %u: %.2f MH/s (avg %.2f), idle %.3f s\n", i,
+               c->hashrate / 1e6, c->hashrate_ewma / 1e6, (double)idle / 1e6);
+    }
+    printf("[telemetry] total %.2f MH/s, up %.0f s, chunks %u, load %.0f us (avg %.0f, max %.0f), "
+           "shares %u (%.2f/min, acc %u rej %u, stale %u), hw err %.4f\n",
+           telemetry_total_hashrate() / 1e6, uptime, t->jobs_loaded,
+           t->job_load_us, t->job_load_us_ewma, t->job_load_us_max,
+           t->shares_found, uptime > 0 ? t->shares_found * 60.0 / uptime : 0.0,
+           t->shares_accepted, t->shares_rejected, t->shares_stale, hw_error_rate());
+    for (uint32_t i = 0; i < TELEMETRY_JOB_SLOTS; i++) {
+        const job_telemetry_t* j = &t->jobs[i];
+        if (j->used) {
+            printf("[telemetry] job %u: acc %u rej %u\n", j->template_id, j->accepted, j->rejected);
+        }
+    }
+    t->last_report_us = now;
+}
+
+// Number of prepared jobs the host can queue ahead of the FPGA
+#ifndef JOB_QUEUE_SIZE
+#define JOB_QUEUE_SIZE 16  // Must be a power of two
+#endif
+
+// Prepared job ready to be loaded into the miner
+typedef struct {
+    uint32_t job_id;
+    mining_params_t params;
+    uint32_t template_id;   // Work template (pool notify) this job came from
+    uint64_t extranonce2;   // Rolled fields needed to rebuild the share
+    uint32_t ntime;
+    uint32_t version;
+    uint32_t generation;    // mining_job_generation the job was made for
+} mining_job_t;
+
+// Queue slot; the sequence number tells producers and the consumer
+// whether the slot is free or filled for their current lap
+typedef struct {
+    volatile uint32_t sequence;
+    mining_job_t job;
+} job_slot_t;
+
+// Bounded lock-free job ring: any number of producers, one consumer
+// (the device loop). Push and pop never block.
+typedef struct {
+    job_slot_t slots[JOB_QUEUE_SIZE];
+    volatile uint32_t head;  // Next position to push
+    volatile uint32_t tail;  // Next position to pop
+} job_queue_t;
+
+void job_queue_init(job_queue_t* queue) {
+    for (uint32_t i = 0; i < JOB_QUEUE_SIZE; i++) {
+        queue->slots[i].sequence = i;
+    }
+    queue->head = 0;
+    queue->tail = 0;
+}
+
+// Push a job; returns 0 on success, -1 if the queue is full
+int job_queue_push(job_queue_t* queue, const mining_job_t* job) {
+    uint32_t pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    
+    while (1) {
+        job_slot_t* slot = &queue->slots[pos & (JOB_QUEUE_SIZE - 1)];
+        uint32_t seq = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        int32_t diff = (int32_t)(seq - pos);
+        
+        if (diff == 0) {
+            // Slot is free for this lap; claim it
+            if (__atomic_compare_exchange_n(&queue->head, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                slot->job = *job;
+                __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+                return 0;
+            }
+        } else if (diff < 0) {
+            return -1;  // Full
+        } else {
+            pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// Pop the oldest job; returns 0 on success, -1 if the queue is empty
+int job_queue_pop(job_queue_t* queue, mining_job_t* job) {
+    uint32_t pos = queue->tail;
+    job_slot_t* slot = &queue->slots[pos & (JOB_QUEUE_SIZE - 1)];
+    uint32_t seq = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    
+    if ((int32_t)(seq - (pos + 1)) < 0) {
+        return -1;  // Empty
+    }
+    
+    *job = slot->job;
+    __atomic_store_n(&slot->sequence, pos + JOB_QUEUE_SIZE, __ATOMIC_RELEASE);
+    __atomic_store_n(&queue->tail, pos + 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+// Approximate number of queued jobs
+uint32_t job_queue_count(const job_queue_t* queue) {
+    return __atomic_load_n(&queue->head, __ATOMIC_RELAXED) -
+           __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+}
+
+// Drop every queued job (consumer side only)
+void job_queue_drain(job_queue_t* queue) {
+    mining_job_t job;
+    while (job_queue_pop(queue, &job) == 0) {
+    }
+}
+
+// Called by the device loop when it has room for more work
+typedef void (*job_refill_t)(job_queue_t* queue, void* ctx);
+
+// Called by the device loop for every golden nonce
+typedef void (*share_found_t)(const mining_job_t* job, uint32_t nonce, void* ctx);
+
+// Hooks for mining_loop_queue(); any of them may be NULL
+typedef struct {
+    job_refill_t refill;
+    share_found_t share_found;
+    void* ctx;
+} mining_hooks_t;
+
+// Golden nonces waiting to leave the device loop
+#ifndef SHARE_QUEUE_SIZE
+#define SHARE_QUEUE_SIZE 64  // Must be a power of two
+#endif
+
+typedef struct {
+    mining_job_t job;
+    uint32_t nonce;
+} share_t;
+
+// Share ring from the device loop (the single producer, in its share
+// hook) to whatever sends shares on (the single consumer). Push never
+// blocks: a full ring drops the share and counts it.
+typedef struct {
+    share_t shares[SHARE_QUEUE_SIZE];
+    volatile uint32_t head;  // Next position to push
+    volatile uint32_t tail;  // Next position to pop
+    volatile uint32_t dropped;
+} share_queue_t;
+
+int share_queue_push(share_queue_t* queue, const mining_job_t* job, uint32_t nonce) {
+    uint32_t head = queue->head;
+    
+    if (head - __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) >= SHARE_QUEUE_SIZE) {
+        __atomic_add_fetch(&queue->dropped, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    queue->shares[head % SHARE_QUEUE_SIZE].job = *job;
+    queue->shares[head % SHARE_QUEUE_SIZE].nonce = nonce;
+    __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int share_queue_pop(share_queue_t* queue, share_t* share) {
+    uint32_t tail = queue->tail;
+    
+    if (tail == __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE)) {
+        return -1;
+    }
+    *share = queue->shares[tail % SHARE_QUEUE_SIZE];
+    __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Drop every queued share (consumer side); returns how many
+uint32_t share_queue_discard(share_queue_t* queue) {
+    uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+    uint32_t count = head - queue->tail;
+    
+    __atomic_store_n(&queue->tail, head, __ATOMIC_RELEASE);
+    return count;
+}
+
+// Status wait slice of the queue-fed loop; short enough that producers
+// polled from the refill hook (e.g. the pool client) stay responsive
+#ifndef QUEUE_LOOP_WAIT_US
+#define QUEUE_LOOP_WAIT_US 1000
+#endif
+
+#ifdef MINER_USE_PREP_THREAD
+// Job preparation thread: runs the refill hook (midstates, merkle roots,
+// pool I/O) so SHA-256 work on the ARM never delays the device loop's
+// reaction to FOUND/NOT_FOUND. The job queue is the hand-off, with this
+// thread its only producer and the device loop its only consumer.
+#ifndef PREP_THREAD_IDLE_US
+#define PREP_THREAD_IDLE_US 500  // Back-off when a pass adds no jobs
+#endif
+
+typedef struct {
+    job_queue_t* queue;
+    job_refill_t refill;
+    void* ctx;
+    volatile int running;
+    pthread_t thread;
+} job_prep_thread_t;
+
+static void* job_prep_main(void* arg) {
+    job_prep_thread_t* prep = (job_prep_thread_t*)arg;
+    
+    while (__atomic_load_n(&prep->running, __ATOMIC_ACQUIRE)) {
+        uint32_t queued = job_queue_count(prep->queue);
+        prep->refill(prep->queue, prep->ctx);
+        if (job_queue_count(prep->queue) <= queued) {
+            usleep(PREP_THREAD_IDLE_US);  // Full, or nothing to prepare
+        }
+    }
+    return NULL;
+}
+
+// Start refilling queue from a thread. Returns 0 on success, -1 if the
+// thread could not be created.
+int job_prep_start(job_prep_thread_t* prep, job_queue_t* queue,
+                   job_refill_t refill, void* ctx) {
+    prep->queue = queue;
+    prep->refill = refill;
+    prep->ctx = ctx;
+    prep->running = 1;
+    if (pthread_create(&prep->thread, NULL, job_prep_main, prep) != 0) {
+        prep->running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+void job_prep_stop(job_prep_thread_t* prep) {
+    __atomic_store_n(&prep->running, 0, __ATOMIC_RELEASE);
+    pthread_join(prep->thread, NULL);
+}
+#endif
+
+// Nonces per chunk handed to a core; smaller chunks bound how long a
+// core keeps hashing abandoned work and let faster cores take more of a
+// job. 2^32 / MINER_NUM_CORES gives the static slice layout.
+#ifndef NONCE_CHUNK_SIZE
+#define NONCE_CHUNK_SIZE 0x10000000
+#endif
+
+// Work handed to one core: a job and a bounded nonce chunk of it
+typedef struct {
+    mining_job_t job;
+    uint32_t nonce_start;
+    uint32_t nonce_end;  // Inclusive
+} work_unit_t;
+
+// Descriptors kept queued per core (a power of two, at most
+// JOB_TABLE_ENTRIES); the ring is topped up in batches once it falls to
+// half of this
+#ifndef JOB_TABLE_PREFETCH
+#define JOB_TABLE_PREFETCH 8
+#endif
+
+// Chunks a core can hold (a power of two): the active banks plus either
+// the shadow banks or the prefetched descriptors
+#ifdef MINER_USE_JOB_TABLE
+#define CORE_SLOT_DEPTH (2 * JOB_TABLE_PREFETCH)
+#else
+#define CORE_SLOT_DEPTH 2
+#endif
+
+// Per-core view of the feeder, as free-running chunk counts. units[tail]
+// is hashing, units up to head wait in the shadow banks or the job
+// table, and units up to filled were cut for the core but not handed to
+// it yet (e.g. its range ran out before it took them).
+typedef struct {
+    work_unit_t units[CORE_SLOT_DEPTH];
+    uint32_t tail;       // Chunk being hashed
+    uint32_t head;       // One past the last chunk handed to the core
+    uint32_t filled;     // One past the last chunk cut for the core
+    uint32_t started;    // Chunk loaded into the active banks at START
+    uint32_t desc_base;  // Job table count at START
+} core_slot_t;
+
+// Device-side state of the queue-fed mining loop. The head job is split
+// into chunks which are handed to whichever core needs work next.
+typedef struct {
+    job_queue_t* queue;
+    mining_job_t job;  // Job being split into chunks
+    int has_job;
+    uint64_t cursor;   // Next nonce of job to hand out
+    uint32_t generation;  // Oldest job generation still worth hashing
+    core_slot_t cores[MINER_NUM_CORES];
+} job_feeder_t;
+
+// Set to stop mining_loop_queue() from another context
+volatile int mining_stop_requested = 0;
+
+// Job generation. A producer starts a new one (e.g. on clean_jobs) with
+// mining_new_generation() and may push fresh jobs straight away: the
+// device loop stops the cores on older work, drops older jobs still
+// queued or preloaded, and discards their late golden nonces.
+volatile uint32_t mining_job_generation = 0;
+
+uint32_t mining_new_generation(void) {
+    return __atomic_add_fetch(&mining_job_generation, 1, __ATOMIC_ACQ_REL);
+}
+
+// Job made before generation was started (wrap-safe)
+static inline int job_is_stale(const mining_job_t* job, uint32_t generation) {
+    return (int32_t)(job->generation - generation) < 0;
+}
+
+static inline int slot_busy(const core_slot_t* slot) {
+    return slot->head != slot->tail;
+}
+
+static inline work_unit_t* slot_unit(core_slot_t* slot, uint32_t n) {
+    return &slot->units[n % CORE_SLOT_DEPTH];
+}
+
+// Cut the next chunk, moving on to the next queued job once the current
+// one is fully handed out. Returns 0 on success, -1 if starved.
+static int feeder_take_unit(job_feeder_t* feeder, work_unit_t* unit) {
+    while (!feeder->has_job || feeder->cursor > 0xFFFFFFFF) {
+        if (job_queue_pop(feeder->queue, &feeder->job) != 0) {
+            feeder->has_job = 0;
+            return -1;
+        }
+        feeder->has_job = !job_is_stale(&feeder->job, feeder->generation);
+        feeder->cursor = 0;
+    }
+    
+    uint64_t end = feeder->cursor + NONCE_CHUNK_SIZE - 1;
+    if (end > 0xFFFFFFFF) {
+        end = 0xFFFFFFFF;
+    }
+    unit->job = feeder->job;
+    unit->nonce_start = (uint32_t)feeder->cursor;
+    unit->nonce_end = (uint32_t)end;
+    feeder->cursor = end + 1;
+    return 0;
+}
+
+// Chunk n of a core: one already cut for it, or a fresh one when n is
+// the next to cut. Returns NULL if starved.
+static work_unit_t* feeder_fill_unit(job_feeder_t* feeder, core_slot_t* slot, uint32_t n) {
+    if (n != slot->filled) {
+        return slot_unit(slot, n);
+    }
+    if (feeder_take_unit(feeder, slot_unit(slot, n)) != 0) {
+        return NULL;
+    }
+    slot->filled++;
+    return slot_unit(slot, n);
+}
+
+// Load a chunk into the active banks of an idle core and start it
+static void feeder_start_core(job_feeder_t* feeder, uint32_t index) {
+    core_slot_t* slot = &feeder->cores[index];
+    work_unit_t* unit = feeder_fill_unit(feeder, slot, slot->head);
+    
+    if (unit == NULL) {
+        telemetry_core_idle(index);
+        return;
+    }
+    uint64_t load_start = miner_time_us();
+    select_core(index);
+    resume_mining(&unit->job.params, unit->nonce_start, unit->nonce_end);
+    telemetry_job_loaded(miner_time_us() - load_start);
+    telemetry_core_started(index);
+    event_log_append(EVLOG_JOB_LOAD, index, unit->job.job_id, unit->nonce_start, unit->nonce_end);
+    slot->started = slot->head++;
+#ifdef MINER_USE_JOB_TABLE
+    slot->desc_base = job_table_fetched();  // SRST emptied the ring
+#endif
+}
+
+// Keep follow-on chunks queued behind the active one so the core swaps
+// at the end of its range without going idle
+static void feeder_arm_core(job_feeder_t* feeder, uint32_t index) {
+    core_slot_t* slot = &feeder->cores[index];
+    
+    if (!slot_busy(slot)) {
+        return;
+    }
+#ifdef MINER_USE_JOB_TABLE
+    // Batch the top-up so one doorbell write covers many descriptors
+    miner_job_desc_t descs[JOB_TABLE_PREFETCH];
+    uint32_t queued = slot->head - slot->tail - 1;
+    uint32_t count = 0;
+    
+    if (queued > JOB_TABLE_PREFETCH / 2) {
+        return;
+    }
+    while (queued + count < JOB_TABLE_PREFETCH) {
+        work_unit_t* unit = feeder_fill_unit(feeder, slot, slot->head + count);
+        if (unit == NULL) {
+            break;
+        }
+        job_desc_init(&descs[count], &unit->job.params, unit->job.job_id,
+                      unit->nonce_start, unit->nonce_end);
+        count++;
+    }
+    if (count == 0) {
+        return;
+    }
+    uint64_t load_start = miner_time_us();
+    select_core(index);
+    slot->head += job_table_post(descs, count);
+    telemetry_job_loaded(miner_time_us() - load_start);
+#else
+    if (slot->head - slot->tail > 1) {
+        return;
+    }
+    work_unit_t* next = feeder_fill_unit(feeder, slot, slot->head);
+    if (next == NULL) {
+        return;
+    }
+    uint64_t load_start = miner_time_us();
+    select_core(index);
+    write_next_job(&next->job.params);
+    write_next_nonce_range(next->nonce_start, next->nonce_end);
+    commit_next_job(JOB_COMMIT_ON_ROLLOVER);
+    telemetry_job_loaded(miner_time_us() - load_start);
+    event_log_append(EVLOG_JOB_LOAD, index, next->job.job_id, next->nonce_start, next->nonce_end);
+    slot->head++;
+#endif
+}
+
+// Retire a core's chunks up to (not including) chunk count, counting
+// them as fully hashed
+static void feeder_retire(core_slot_t* slot, uint32_t index, uint32_t count) {
+    while (slot->tail != count && slot_busy(slot)) {
+        work_unit_t* unit = slot_unit(slot, slot->tail);
+        telemetry_chunk_done(index, (uint64_t)unit->nonce_end - unit->nonce_start + 1);
+        slot->tail++;
+    }
+}
+
+// Chunk the selected core moved to after JOB_SWAP
+static uint32_t feeder_swapped_tail(const core_slot_t* slot) {
+#ifdef MINER_USE_JOB_TABLE
+    // Several descriptors may have been fetched since the last event
+    uint32_t fetched = job_table_fetched() - slot->desc_base;
+    return (fetched < slot->head - slot->started) ? slot->started + fetched : slot->head - 1;
+#else
+    return slot->tail + 1;
+#endif
+}
+
+// Abort work of generations before generation: cores hashing it are
+// stopped at once (the reset also empties their result FIFO), and their
+// preloaded and cut chunks and the partly cut job are dropped
+static void feeder_flush(job_feeder_t* feeder, uint32_t generation) {
+    feeder->generation = generation;
+    if (feeder->has_job && job_is_stale(&feeder->job, generation)) {
+        feeder->has_job = 0;
+    }
+    for (uint32_t i = 0; i < miner_core_count; i++) {
+        core_slot_t* slot = &feeder->cores[i];
+        if (slot->filled == slot->tail ||
+            !job_is_stale(&slot_unit(slot, slot->tail)->job, generation)) {
+            continue;  // Nothing held, or already fresh work
+        }
+        if (slot_busy(slot)) {
+            select_core(i);
+            stop_mining();
+            telemetry_chunk_abandoned(i);
+        }
+        slot->tail = slot->filled;
+        slot->head = slot->filled;
+    }
+    select_core(0);
+    event_log_append(EVLOG_RESTART, generation, 0, 0, 0);
+}
+
+// Mining loop fed from a job queue: jobs are cut into chunks and loaded
+// back-to-back as each core exhausts its range, until
+// mining_stop_requested is set
+void mining_loop_queue(job_queue_t* queue, const mining_hooks_t* hooks) {
+    printf("Starting Bitcoin mining loop (QUEUE MODE, %u cores)...\n", miner_core_count);
+    
+    job_feeder_t feeder;
+    memset(&feeder, 0, sizeof(feeder));
+    feeder.queue = queue;
+    feeder.generation = __atomic_load_n(&mining_job_generation, __ATOMIC_ACQUIRE);
+    
+#ifdef MINER_USE_PREP_THREAD
+    // Hand the refill hook to the preparation thread
+    job_prep_thread_t prep;
+    mining_hooks_t device_hooks = *hooks;
+    int prep_running = 0;
+    if (hooks->refill && job_prep_start(&prep, queue, hooks->refill, hooks->ctx) == 0) {
+        device_hooks.refill = NULL;
+        hooks = &device_hooks;
+        prep_running = 1;
+    }
+#endif
+    
+    telemetry_init();
+    uint64_t last_sample_us = miner_time_us();
+    while (!mining_stop_requested) {
+        if (hooks->refill) {
+            hooks->refill(queue, hooks->ctx);
+        }
+        
+        uint32_t generation = __atomic_load_n(&mining_job_generation, __ATOMIC_ACQUIRE);
+        if (generation != feeder.generation) {
+            feeder_flush(&feeder, generation);
+            if (hooks->refill) {
+                hooks->refill(queue, hooks->ctx);
+            }
+        }
+        
+        int busy = 0;
+        for (uint32_t i = 0; i < miner_core_count; i++) {
+            if (!slot_busy(&feeder.cores[i])) {
+                feeder_start_core(&feeder, i);
+            }
+            feeder_arm_core(&feeder, i);
+            busy |= slot_busy(&feeder.cores[i]);
+        }
+        select_core(0);
+        if (!busy) {
+            event_log_drain(EVENT_LOG_DRAIN_BATCH);
+            usleep(miner_poll_interval_us);  // Starved, wait for producers
+            continue;
+        }
+        
+        // Sample hashrate and print the periodic summary
+        uint64_t now = miner_time_us();
+        if (now - last_sample_us >= TELEMETRY_SAMPLE_US) {
+            for (uint32_t i = 0; i < miner_core_count; i++) {
+                core_slot_t* slot = &feeder.cores[i];
+                if (slot_busy(slot)) {
+                    select_core(i);
+                    telemetry_sample_core(i, slot_unit(slot, slot->tail)->nonce_start);
+                }
+            }
+            select_core(0);
+            if (miner_clock_tuner.enabled) {
+                clock_tune_step(&miner_clock_tuner);
+            }
+            event_log_drain(EVENT_LOG_SIZE);  // The loop may never go idle
+            last_sample_us = now;
+        }
+        if (now - miner_telemetry.last_report_us >= TELEMETRY_REPORT_US) {
+            telemetry_report();
+        }
+        
+        uint32_t core_events[MINER_NUM_CORES];
+        if (!miner_wait_core_events(QUEUE_LOOP_WAIT_US, core_events)) {
+            event_log_drain(EVENT_LOG_DRAIN_BATCH);  // Nothing to service
+            continue;
+        }
+        
+        for (uint32_t i = 0; i < miner_core_count; i++) {
+            core_slot_t* slot = &feeder.cores[i];
+            uint32_t events = core_events[i];
+            select_core(i);
+            
+            if ((events & MINER_EVENT_FOUND) && slot_busy(slot)) {
+                // Drain every result; the core keeps hashing its chunk
+                uint32_t nonces[RESULT_FIFO_DEPTH];
+                int valid[RESULT_FIFO_DEPTH];
+                uint32_t count = drain_golden_nonces(nonces, RESULT_FIFO_DEPTH);
+                mining_job_t* current = &slot_unit(slot, slot->tail)->job;
+                check_golden_nonces(&current->params, nonces, count, valid);
+                
+                for (uint32_t n = 0; n < count; n++) {
+                    // The core may already have moved on to a queued chunk
+                    mining_job_t* job = current;
+                    for (uint32_t u = slot->tail + 1; !valid[n] && u != slot->head; u++) {
+                        if (job_nonce_valid(&slot_unit(slot, u)->job.params, nonces[n])) {
+                            job = &slot_unit(slot, u)->job;
+                            valid[n] = 1;
+                        }
+                    }
+                    record_golden_nonce(nonces[n], valid[n]);
+                    if (valid[n]) {
+                        miner_telemetry.shares_found++;
+                    }
+                    
+                    event_log_append(EVLOG_GOLDEN_NONCE, i, job->job_id, nonces[n], 0);
+                    // A producer may have moved on since the last flush
+                    if (!valid[n]) {
+                        continue;
+                    }
+                    if (job_is_stale(job, __atomic_load_n(&mining_job_generation, __ATOMIC_ACQUIRE))) {
+                        miner_telemetry.shares_stale++;
+                    } else if (hooks->share_found) {
+                        hooks->share_found(job, nonces[n], hooks->ctx);
+                    }
+                }
+            }
+            
+            if ((events & MINER_EVENT_JOB_SWAP) && slot->head - slot->tail > 1) {
+                feeder_retire(slot, i, feeder_swapped_tail(slot));
+                event_log_append(EVLOG_JOB_SWAP, i, slot->tail, 0, 0);
+            }
+            
+            if ((events & MINER_EVENT_NOT_FOUND) && slot_busy(slot)) {
+                // Range exhausted before the core took anything queued
+                // behind it; those chunks start over on the next pass
+                feeder_retire(slot, i, slot->tail + 1);
+                slot->head = slot->tail;
+                event_log_append(EVLOG_RANGE_DONE, i, 0, 0, 0);
+                if (slot->filled == slot->tail) {
+                    telemetry_core_idle(i);
+                }
+            }
+        }
+        select_core(0);
+    }
+    
+    stop_all_cores();
+#ifdef MINER_USE_PREP_THREAD
+    if (prep_running) {
+        job_prep_stop(&prep);
+    }
+#endif
+    event_log_drain(EVENT_LOG_SIZE);
+    printf("Mining loop completed\n");
+}
+
+// Limits of the work template
+#define MAX_COINBASE_PART    256
+#define MAX_EXTRANONCE_SIZE  8
+#define MAX_MERKLE_BRANCHES  16
+
+// How far ntime may be rolled past the template time (seconds)
+#ifndef NTIME_ROLL_MAX
+#define NTIME_ROLL_MAX 60
+#endif
+
+// Version bits rolled when the pool allows it (BIP 310; the BIP 320
+// general-purpose bits). Each value gives another midstate over the same
+// merkle root and residual, so it extends a job without coinbase work.
+#ifndef VERSION_ROLL_MASK
+#define VERSION_ROLL_MASK 0x1FFFE000
+#endif
+
+// Work template from the pool: everything needed to build headers for
+// any extranonce2/ntime combination
+typedef struct {
+    uint32_t template_id;
+    uint32_t version;
+    uint8_t prev_block[32];
+    uint8_t coinbase1[MAX_COINBASE_PART];
+    uint32_t coinbase1_len;
+    uint8_t coinbase2[MAX_COINBASE_PART];
+    uint32_t coinbase2_len;
+    uint8_t extranonce1[MAX_EXTRANONCE_SIZE];
+    uint32_t extranonce1_len;
+    uint32_t extranonce2_len;
+    uint8_t merkle_branch[MAX_MERKLE_BRANCHES][32];
+    uint32_t merkle_count;
+    uint32_t bits;
+    uint32_t ntime;
+    uint32_t ntime_roll_max;  // 0 disables ntime rolling
+    uint32_t version_mask;    // Rollable version bits, 0 disables
+    uint32_t target[8];       // Share target
+} job_template_t;
+
+// Merkle roots are built for this many consecutive extranonce2 values at
+// a time, one per SHA-256 lane
+#define MERKLE_BATCH 4
+
+// Coinbase bytes past the prefix's last whole block: under one block of
+// prefix, extranonce2, coinbase2 and padding
+#define MERKLE_TAIL_MAX ((63 + MAX_EXTRANONCE_SIZE + MAX_COINBASE_PART + 9 + 63) / 64 * 64)
+
+// Per-template merkle state. coinbase1 || extranonce1 is the same for
+// every extranonce2, so its whole blocks are hashed once; the branch
+// hashes are kept as the words the fold feeds to SHA-256.
+typedef struct {
+    uint32_t prefix_state[8];        // SHA-256 state after the prefix blocks
+    uint8_t tail[MERKLE_TAIL_MAX];   // Padded rest of the coinbase
+    uint32_t tail_blocks;
+    uint32_t extranonce2_offset;     // Of the extranonce2 field in tail
+    uint32_t extranonce2_len;
+    uint32_t branch[MAX_MERKLE_BRANCHES][8];
+    uint32_t branch_count;
+} merkle_builder_t;
+
+// Rolling position within a template
+typedef struct {
+    const job_template_t* tmpl;
+    uint64_t extranonce2;
+    uint32_t ntime_offset;
+    uint32_t version_index;   // Spread over version_mask
+    uint32_t next_job_id;
+    uint32_t generation;      // Stamped on every job rolled
+    merkle_builder_t merkle;
+    uint8_t merkle_roots[MERKLE_BATCH][32];  // From extranonce2 merkle_base on
+    uint64_t merkle_base;
+    int merkle_valid;
+    int exhausted;
+} job_roller_t;
+
+// Write extranonce2 as a fixed-size big-endian byte string
+static void encode_extranonce2(uint64_t extranonce2, uint32_t len, uint8_t* out) {
+    for (uint32_t i = 0; i < len; i++) {
+        out[len - 1 - i] = (uint8_t)(extranonce2 >> (8 * i));
+    }
+}
+
+// Hash the coinbase for one extranonce2 and fold it through the branch
+// (one-off; the roller uses the batched merkle_builder_t below)
+void build_merkle_root(const job_template_t* tmpl, uint64_t extranonce2, uint8_t root[32]) {
+    uint8_t coinbase[MAX_COINBASE_PART * 2 + MAX_EXTRANONCE_SIZE * 2];
+    uint32_t len = 0;
+    
+    memcpy(coinbase + len, tmpl->coinbase1, tmpl->coinbase1_len);
+    len += tmpl->coinbase1_len;
+    memcpy(coinbase + len, tmpl->extranonce1, tmpl->extranonce1_len);
+    len += tmpl->extranonce1_len;
+    encode_extranonce2(extranonce2, tmpl->extranonce2_len, coinbase + len);
+    len += tmpl->extranonce2_len;
+    memcpy(coinbase + len, tmpl->coinbase2, tmpl->coinbase2_len);
+    len += tmpl->coinbase2_len;
+    
+    sha256d(coinbase, len, root);
+    
+    uint8_t pair[64];
+    for (uint32_t i = 0; i < tmpl->merkle_count; i++) {
+        memcpy(pair, root, 32);
+        memcpy(pair + 32, tmpl->merkle_branch[i], 32);
+        sha256d(pair, 64, root);
+    }
+}
+
+void merkle_builder_init(merkle_builder_t* builder, const job_template_t* tmpl) {
+    uint8_t prefix[MAX_COINBASE_PART + MAX_EXTRANONCE_SIZE];
+    uint32_t prefix_len = tmpl->coinbase1_len + tmpl->extranonce1_len;
+    uint32_t whole = prefix_len & ~63u;
+    
+    memcpy(prefix, tmpl->coinbase1, tmpl->coinbase1_len);
+    memcpy(prefix + tmpl->coinbase1_len, tmpl->extranonce1, tmpl->extranonce1_len);
+    memcpy(builder->prefix_state, sha256_iv, sizeof(sha256_iv));
+    for (uint32_t offset = 0; offset < whole; offset += 64) {
+        sha256_block(builder->prefix_state, prefix + offset);
+    }
+    
+    // The tail with the extranonce2 field left zero, plus SHA-256 padding
+    uint32_t len = prefix_len - whole;
+    memset(builder->tail, 0, sizeof(builder->tail));
+    memcpy(builder->tail, prefix + whole, len);
+    builder->extranonce2_offset = len;
+    builder->extranonce2_len = tmpl->extranonce2_len;
+    len += tmpl->extranonce2_len;
+    memcpy(builder->tail + len, tmpl->coinbase2, tmpl->coinbase2_len);
+    len += tmpl->coinbase2_len;
+    
+    uint64_t bit_length = (uint64_t)(whole + len) * 8;
+    builder->tail[len++] = 0x80;
+    len = (len + 8 + 63) & ~63u;
+    store_be32(builder->tail + len - 8, (uint32_t)(bit_length >> 32));
+    store_be32(builder->tail + len - 4, (uint32_t)bit_length);
+    builder->tail_blocks = len / 64;
+    
+    builder->branch_count = tmpl->merkle_count;
+    for (uint32_t n = 0; n < tmpl->merkle_count; n++) {
+        for (int i = 0; i < 8; i++) {
+            builder->branch[n][i] = load_be32(tmpl->merkle_branch[n] + (i * 4));
+        }
+    }
+}
+
+// Merkle roots for extranonce2 .. extranonce2 + MERKLE_BATCH - 1, all
+// lanes stepping through the coinbase tail and the branch fold together
+void merkle_builder_roots(const merkle_builder_t* builder, uint64_t extranonce2,
+                          uint8_t roots[MERKLE_BATCH][32]) {
+    uint8_t tail[MERKLE_BATCH][MERKLE_TAIL_MAX];
+    uint32_t state[8][4];
+    uint32_t data[16][4];
+    
+    for (int lane = 0; lane < MERKLE_BATCH; lane++) {
+        memcpy(tail[lane], builder->tail, builder->tail_blocks * 64);
+        encode_extranonce2(extranonce2 + lane, builder->extranonce2_len,
+                           tail[lane] + builder->extranonce2_offset);
+        for (int i = 0; i < 8; i++) {
+            state[i][lane] = builder->prefix_state[i];
+        }
+    }
+    
+    // Coinbase txid
+    for (uint32_t block = 0; block < builder->tail_blocks; block++) {
+        for (int i = 0; i < 16; i++) {
+            for (int lane = 0; lane < MERKLE_BATCH; lane++) {
+                data[i][lane] = load_be32(tail[lane] + (block * 64) + (i * 4));
+            }
+        }
+        sha256_transform_x4(state, data);
+    }
+    sha256_hash32_x4(state);
+    
+    // Fold through the branch, which sits on the right at every level
+    for (uint32_t n = 0; n < builder->branch_count; n++) {
+        for (int i = 0; i < 8; i++) {
+            for (int lane = 0; lane < MERKLE_BATCH; lane++) {
+                data[i][lane] = state[i][lane];
+                data[i + 8][lane] = builder->branch[n][i];
+            }
+        }
+        sha256d_block_x4(state, data);
+    }
+    
+    for (int lane = 0; lane < MERKLE_BATCH; lane++) {
+        for (int i = 0; i < 8; i++) {
+            store_be32(roots[lane] + (i * 4), state[i][lane]);
+        }
+    }
+}
+
+// Spread the low bits of value over the set bits of mask (software PDEP)
+static uint32_t deposit_bits(uint32_t value, uint32_t mask) {
+    uint32_t out = 0;
+    
+    for (uint32_t bit = 1; mask; bit <<= 1) {
+        if (value & bit) {
+            out |= mask & (~mask + 1);  // Lowest remaining mask bit
+        }
+        mask &= mask - 1;
+    }
+    return out;
+}
+
+void job_roller_init(job_roller_t* roller, const job_template_t* tmpl) {
+    memset(roller, 0, sizeof(*roller));
+    roller->tmpl = tmpl;
+    merkle_builder_init(&roller->merkle, tmpl);
+    roller->generation = __atomic_load_n(&mining_job_generation, __ATOMIC_ACQUIRE);
+}
+
+// Produce the next job from the template. Version bits are rolled first:
+// consecutive jobs then share merkle root and residual and differ only in
+// midstate, so making one costs a single compression. Each job is still
+// searched on its own: the feeder cuts it into nonce chunks for the cores
+// and moves on to the next job once its chunks are handed out. Next comes
+// ntime, which only changes a residual word; once the ntime window is
+// used up the extranonce2 is bumped, which takes the next merkle root of
+// the current batch (or builds the next batch).
+// Returns 0 on success, -1 once the extranonce2 space is exhausted.
+int job_roller_next(job_roller_t* roller, mining_job_t* job) {
+    const job_template_t* tmpl = roller->tmpl;
+    
+    if (roller->exhausted) {
+        return -1;
+    }
+    
+    if (!roller->merkle_valid || roller->extranonce2 - roller->merkle_base >= MERKLE_BATCH) {
+        merkle_builder_roots(&roller->merkle, roller->extranonce2, roller->merkle_roots);
+        roller->merkle_base = roller->extranonce2;
+        roller->merkle_valid = 1;
+    }
+    
+    uint32_t version = tmpl->version ^ deposit_bits(roller->version_index, tmpl->version_mask);
+    block_header_wire_t header;
+    header.version = host_to_le32(version);
+    memcpy(header.prev_block, tmpl->prev_block, 32);
+    memcpy(header.merkle_root, roller->merkle_roots[roller->extranonce2 - roller->merkle_base], 32);
+    header.timestamp = host_to_le32(tmpl->ntime + roller->ntime_offset);
+    header.bits = host_to_le32(tmpl->bits);
+    header.nonce = 0;
+    
+    job->job_id = roller->next_job_id++;
+    job->template_id = tmpl->template_id;
+    job->extranonce2 = roller->extranonce2;
+    job->ntime = tmpl->ntime + roller->ntime_offset;
+    job->version = version;
+    job->generation = roller->generation;
+    process_wire_header(&header, &job->params);
+    memcpy(job->params.target, tmpl->target, sizeof(job->params.target));
+    
+    // Advance to the next position; the version index wraps to 0 once
+    // it no longer fits in the mask
+    if (deposit_bits(++roller->version_index, tmpl->version_mask) != 0) {
+        return 0;
+    }
+    roller->version_index = 0;
+    if (roller->ntime_offset < tmpl->ntime_roll_max) {
+        roller->ntime_offset++;
+    } else {
+        uint64_t limit = (tmpl->extranonce2_len >= 8) ? UINT64_MAX :
+            ((uint64_t)1 << (8 * tmpl->extranonce2_len)) - 1;
+        roller->ntime_offset = 0;
+        if (roller->extranonce2 >= limit) {
+            roller->exhausted = 1;
+        } else {
+            roller->extranonce2++;
+        }
+    }
+    return 0;
+}
+
+// Refill hook for mining_loop_queue(): keeps the queue topped up from a
+// roller so the next job is ready before the current range finishes
+void roller_refill(job_queue_t* queue, void* ctx) {
+    job_roller_t* roller = (job_roller_t*)ctx;
+    
+    while (job_queue_count(queue) < JOB_QUEUE_SIZE - 1) {
+        mining_job_t job;
+        if (job_roller_next(roller, &job) != 0) {
+            break;
+        }
+        if (job_queue_push(queue, &job) != 0) {
+            break;
+        }
+    }
+}
+
+// Fill a template with a fixed demo coinbase and the easy test target
+static void demo_template_init(job_template_t* tmpl) {
+    static const uint8_t demo_coinbase1[] = {
+        0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0x08
+    };
+    static const uint8_t demo_coinbase2[] = {
+        0xFF, 0xFF, 0xFF, 0xFF, 0x01, 0x00, 0xF2, 0x05, 0x2A, 0x01, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+    };
+    
+    memset(tmpl, 0, sizeof(*tmpl));
+    tmpl->version = 0x20000000;
+    memcpy(tmpl->coinbase1, demo_coinbase1, sizeof(demo_coinbase1));
+    tmpl->coinbase1_len = sizeof(demo_coinbase1);
+    memcpy(tmpl->coinbase2, demo_coinbase2, sizeof(demo_coinbase2));
+    tmpl->coinbase2_len = sizeof(demo_coinbase2);
+    tmpl->extranonce1_len = 4;
+    tmpl->extranonce2_len = 4;
+    tmpl->bits = 0x1D00FFFF;
+    tmpl->ntime = (uint32_t)time(NULL);
+    tmpl->ntime_roll_max = NTIME_ROLL_MAX;
+    tmpl->version_mask = VERSION_ROLL_MASK;
+    memcpy(tmpl->target, test_easy_target, sizeof(tmpl->target));
+}
+
+// Continuous mining from the job queue with easy test jobs rolled from
+// a fixed demo coinbase
+void mining_loop_continuous(void) {
+    static job_queue_t queue;
+    static job_template_t tmpl;
+    job_roller_t roller;
+    
+    demo_template_init(&tmpl);
+    mining_hooks_t hooks = { roller_refill, NULL, &roller };
+    
+    job_queue_init(&queue);
+    job_roller_init(&roller, &tmpl);
+    mining_loop_queue(&queue, &hooks);
+}
+
+#ifdef MINER_USE_STRATUM
+// Stratum v1 pool client. Runs from the refill hook of the queue-fed loop:
+// each call drains the socket without blocking, turns mining.notify into a
+// work template and keeps the job queue topped up from it.
+
+#define STRATUM_RX_SIZE        8192
+#define STRATUM_TX_SIZE        1024  // One outgoing message
+#define STRATUM_TX_BUFFER      8192  // Sent bytes the socket has not taken yet
+#define STRATUM_TEMPLATE_SLOTS 4
+#define STRATUM_JOB_NAME_LEN   64
+#define STRATUM_NO_TEMPLATE    0xFFFFFFFF  // template_id of a retired slot
+
+// Refill calls between reconnect attempts (about 5 s at the loop rate)
+#ifndef STRATUM_RECONNECT_POLLS
+#define STRATUM_RECONNECT_POLLS 5000
+#endif
+
+// Time a TCP connect may take before the attempt is given up
+#ifndef STRATUM_CONNECT_TIMEOUT_US
+#define STRATUM_CONNECT_TIMEOUT_US 10000000
+#endif
+
+// Share submission. The share hook only queues verified shares, so the
+// device loop never waits on the pool; the refill hook (the prep thread
+// when there is one) drops duplicates, sends mining.submit without
+// waiting for the answer and matches answers to outstanding requests by
+// id. Requests unanswered after SHARE_RETRY_US are resent, up to
+// SHARE_MAX_RETRIES times. With SHARE_OUTSTANDING requests in flight new
+// shares wait in the queue; a full queue drops them.
+#ifndef SHARE_OUTSTANDING
+#define SHARE_OUTSTANDING 16
+#endif
+#ifndef SHARE_RETRY_US
+#define SHARE_RETRY_US 10000000
+#endif
+#ifndef SHARE_MAX_RETRIES
+#define SHARE_MAX_RETRIES 2
+#endif
+#define SHARE_DEDUP_SIZE 64  // Recent shares remembered for deduplication
+
+// mining.submit awaiting the pool's answer
+typedef struct {
+    share_t share;
+    uint32_t id;       // JSON-RPC id, 0 = free
+    uint64_t sent_us;
+    uint32_t retries;
+} share_request_t;
+
+typedef struct {
+    int sock;
+    int connecting;            // TCP connect in progress
+    int connected;             // Session up: handshake sent
+    uint64_t connect_deadline_us;
+    struct sockaddr_in addr;   // Pool address, resolved once
+    int have_addr;
+    char host[128];
+    char port[8];
+    char worker[128];
+    char password[64];
+    
+    char rx[STRATUM_RX_SIZE];
+    uint32_t rx_len;
+    char tx[STRATUM_TX_BUFFER];
+    uint32_t tx_len;
+    uint32_t next_id;
+    uint32_t subscribe_id;
+    uint32_t authorize_id;
+    uint32_t suggest_id;
+    uint32_t configure_id;
+    int authorized;
+    uint32_t reconnect_wait;
+    
+    uint8_t extranonce1[MAX_EXTRANONCE_SIZE];
+    uint32_t extranonce1_len;
+    uint32_t extranonce2_len;
+    double difficulty;
+    double suggested_difficulty;  // Sent after authorize when > 0
+    uint32_t version_mask_request;  // Asked for in mining.configure, 0 = none
+    uint32_t version_mask;          // Granted by the pool for this session
+    
+    // Recent templates; template_id % STRATUM_TEMPLATE_SLOTS is the slot
+    job_template_t templates[STRATUM_TEMPLATE_SLOTS];
+    char job_names[STRATUM_TEMPLATE_SLOTS][STRATUM_JOB_NAME_LEN];
+    uint32_t template_count;
+    int have_template;
+    job_roller_t roller;
+    job_queue_t* queue;
+    
+    share_queue_t share_queue;
+    share_request_t requests[SHARE_OUTSTANDING];
+    uint32_t recent[SHARE_DEDUP_SIZE][2];  // job_id, nonce of recent submits
+    uint32_t recent_count;
+    uint32_t dropped_reported;
+    
+    uint32_t shares_submitted;
+    uint32_t shares_accepted;
+    uint32_t shares_rejected;
+    uint32_t shares_duplicate;
+    uint32_t shares_stale;     // Queued before a clean_jobs
+    uint32_t shares_lost;      // Unanswered or cut off by a disconnect
+} stratum_client_t;
+
+// Minimal JSON scanning for the handful of Stratum messages
+
+static const char* json_ws(const char* p) {
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+        p++;
+    }
+    return p;
+}
+
+// Return the position just past the value at p, or NULL if malformed
+static const char* json_skip(const char* p) {
+    p = json_ws(p);
+    
+    if (*p == '"') {
+        p++;
+        while (*p && *p != '"') {
+            if (*p == '\\' && p[1]) {
+                p++;
+            }
+            p++;
+        }
+        return *p ? p + 1 : NULL;
+    }
+    
+    if (*p == '[' || *p == '{') {
+        char close = (*p == '[') ? ']' : '}';
+        p = json_ws(p + 1);
+        if (*p == close) {
+            return p + 1;
+        }
+        while (1) {
+            if (close == '}') {
+                p = json_skip(p);  // Member name
+                if (!p) {
+                    return NULL;
+                }
+                p = json_ws(p);
+                if (*p != ':') {
+                    return NULL;
+                }
+                p++;
+            }
+            p = json_skip(p);
+            if (!p) {
+                return NULL;
+            }
+            p = json_ws(p);
+            if (*p == ',') {
+                p++;
+            } else if (*p == close) {
+                return p + 1;
+            } else {
+                return NULL;
+            }
+        }
+    }
+    
+    // Number or literal
+    const char* start = p;
+    while (*p && *p != ',' && *p != ']' && *p != '}' &&
+           *p != ' ' && *p != '\r' && *p != '\n') {
+        p++;
+    }
+    return (p == start) ? NULL : p;
+}
+
+// Find a member of the object at obj
+static const char* json_get(const char* obj, const char* key) {
+    const char* p = json_ws(obj);
+    size_t key_len = strlen(key);
+    
+    if (*p != '{') {
+        return NULL;
+    }
+    p = json_ws(p + 1);
+    
+    while (*p == '"') {
+        const char* name = p + 1;
+        const char* end = json_skip(p);
+        if (!end) {
+            return NULL;
+        }
+        p = json_ws(end);
+        if (*p != ':') {
+            return NULL;
+        }
+        const char* value = json_ws(p + 1);
+        if ((size_t)(end - 1 - name) == key_len && memcmp(name, key, key_len) == 0) {
+            return value;
+        }
+        p = json_skip(value);
+        if (!p) {
+            return NULL;
+        }
+        p = json_ws(p);
+        if (*p == ',') {
+            p = json_ws(p + 1);
+        }
+    }
+    return NULL;
+}
+
+// Find element index of the array at arr
+static const char* json_index(const char* arr, int index) {
+    const char* p = json_ws(arr);
+    
+    if (*p != '[') {
+        return NULL;
+    }
+    p = json_ws(p + 1);
+    
+    for (int i = 0; *p && *p != ']'; i++) {
+        if (i == index) {
+            return p;
+        }
+        p = json_skip(p);
+        if (!p) {
+            return NULL;
+        }
+        p = json_ws(p);
+        if (*p == ',') {
+            p = json_ws(p + 1);
+        }
+    }
+    return NULL;
+}
+
+// Copy the string value at p; returns 0 on success
+static int json_string(const char* p, char* out, size_t size) {
+    size_t n = 0;
+    
+    if (!p || *p != '"') {
+        return -1;
+    }
+    for (p++; *p && *p != '"'; p++) {
+        if (*p == '\\' && p[1]) {
+            p++;
+        }
+        if (n + 1 < size) {
+            out[n++] = *p;
+        }
+    }
+    out[n] = '\0';
+    return 0;
+}
+
+static int json_is_true(const char* p) {
+    return p && strncmp(p, "true", 4) == 0;
+}
+
+static int json_is_null(const char* p) {
+    return !p || strncmp(p, "null", 4) == 0;
+}
+
+// Decode a hex string; returns the byte count or -1
+static int hex_decode(const char* hex, uint8_t* out, uint32_t max_len) {
+    uint32_t len = 0;
+    
+    while (hex[0] && hex[1]) {
+        unsigned int byte;
+        if (len >= max_len || sscanf(hex, "%2x", &byte) != 1) {
+            return -1;
+        }
+        out[len++] = (uint8_t)byte;
+        hex += 2;
+    }
+    return hex[0] ? -1 : (int)len;
+}
+
+static void hex_encode(const uint8_t* data, uint32_t len, char* out) {
+    static const char digits[] = "0123456789abcdef";
+    for (uint32_t i = 0; i < len; i++) {
+        out[i * 2] = digits[data[i] >> 4];
+        out[i * 2 + 1] = digits[data[i] & 0xF];
+    }
+    out[len * 2] = '\0';
+}
+
+// Hand buffered bytes to the socket as far as it takes them without
+// blocking. Returns -1 if the connection failed.
+static int stratum_flush(stratum_client_t* client) {
+    uint32_t sent = 0;
+    
+    while (sent < client->tx_len) {
+        int n = send(client->sock, client->tx + sent, client->tx_len - sent, 0);
+        if (n > 0) {
+            sent += (uint32_t)n;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;  // Rest goes out on a later poll
+        } else {
+            return -1;
+        }
+    }
+    client->tx_len -= sent;
+    memmove(client->tx, client->tx + sent, client->tx_len);
+    return 0;
+}
+
+// Send one newline-terminated message through the TX buffer; never
+// waits for the socket. Returns 0 on success, -1 if the connection
+// failed or the pool has stopped reading.
+static int stratum_send(stratum_client_t* client, const char* line) {
+    size_t len = strlen(line);
+    
+    if (client->tx_len + len > STRATUM_TX_BUFFER) {
+        printf("Stratum: send buffer full\n");
+        return -1;
+    }
+    memcpy(client->tx + client->tx_len, line, len);
+    client->tx_len += (uint32_t)len;
+    return stratum_flush(client);
+}
+
+// The session's work died with it: its job names mean nothing to the next
+// session and its extranonce1 may change. Start a new generation so the
+// cores drop the queued, preloaded and running jobs and idle until the
+// next session's first notify, and retire the templates so shares still
+// in flight from them can no longer match.
+static void stratum_end_session_work(stratum_client_t* client) {
+    if (!client->have_template) {
+        return;
+    }
+    mining_new_generation();
+    for (uint32_t i = 0; i < STRATUM_TEMPLATE_SLOTS; i++) {
+        client->templates[i].template_id = STRATUM_NO_TEMPLATE;
+    }
+    client->have_template = 0;
+}
+
+static void stratum_disconnect(stratum_client_t* client) {
+    if (client->sock >= 0) {
+        stratum_close(client->sock);
+    }
+    stratum_end_session_work(client);
+    // Answers to requests of this session will never come
+    for (uint32_t i = 0; i < SHARE_OUTSTANDING; i++) {
+        if (client->requests[i].id != 0) {
+            client->requests[i].id = 0;
+            client->shares_lost++;
+        }
+    }
+    client->sock = -1;
+    client->connecting = 0;
+    client->connected = 0;
+    client->authorized = 0;
+    client->rx_len = 0;
+    client->tx_len = 0;
+    client->reconnect_wait = STRATUM_RECONNECT_POLLS;
+}
+
+// TCP connection up: send configure, subscribe and authorize back-to-back
+static int stratum_start_session(stratum_client_t* client) {
+    char line[STRATUM_TX_SIZE];
+    
+    client->connecting = 0;
+    client->connected = 1;
+    client->rx_len = 0;
+    client->tx_len = 0;
+    client->version_mask = 0;
+    
+    // BIP 310: negotiate version rolling before subscribing
+    if (client->version_mask_request) {
+        client->configure_id = client->next_id++;
+        snprintf(line, sizeof(line),
+                 "{\"id\":%u,\"method\":\"mining.configure\",\"params\":[[\"version-rolling\"],"
+                 "{\"version-rolling.mask\":\"%08x\",\"version-rolling.min-bit-count\":2}]}\n",
+                 client->configure_id, client->version_mask_request);
+        if (stratum_send(client, line) != 0) {
+            stratum_disconnect(client);
+            return -1;
+        }
+    }
+    
+    client->subscribe_id = client->next_id++;
+    snprintf(line, sizeof(line),
+             "{\"id\":%u,\"method\":\"mining.subscribe\",\"params\":[\"fpga_mining/1.0\"]}\n",
+             client->subscribe_id);
+    if (stratum_send(client, line) != 0) {
+        stratum_disconnect(client);
+        return -1;
+    }
+    
+    client->authorize_id = client->next_id++;
+    snprintf(line, sizeof(line),
+             "{\"id\":%u,\"method\":\"mining.authorize\",\"params\":[\"%s\",\"%s\"]}\n",
+             client->authorize_id, client->worker, client->password);
+    if (stratum_send(client, line) != 0) {
+        stratum_disconnect(client);
+        return -1;
+    }
+    
+    if (client->suggested_difficulty > 0.0) {
+        client->suggest_id = client->next_id++;
+        snprintf(line, sizeof(line),
+                 "{\"id\":%u,\"method\":\"mining.suggest_difficulty\",\"params\":[%.6g]}\n",
+                 client->suggest_id, client->suggested_difficulty);
+        if (stratum_send(client, line) != 0) {
+            stratum_disconnect(client);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Start connecting on a non-blocking socket; stratum_poll() finishes the
+// connect and starts the session. The pool name is resolved on the first
+// attempt only, so reconnects never wait on DNS. Returns 0 unless the
+// attempt failed at once.
+int stratum_connect(stratum_client_t* client) {
+    printf("Connecting to stratum+tcp://%s:%s...\n", client->host, client->port);
+    if (!client->have_addr) {
+        struct addrinfo hints;
+        struct addrinfo* result = NULL;
+        
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(client->host, client->port, &hints, &result) != 0 || result == NULL) {
+            printf("Stratum: cannot resolve %s\n", client->host);
+            client->reconnect_wait = STRATUM_RECONNECT_POLLS;
+            return -1;
+        }
+        memcpy(&client->addr, result->ai_addr, sizeof(client->addr));
+        client->have_addr = 1;
+        freeaddrinfo(result);
+    }
+    
+    client->sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (client->sock >= 0) {
+        fcntl(client->sock, F_SETFL, fcntl(client->sock, F_GETFL, 0) | O_NONBLOCK);
+    }
+    if (client->sock < 0 ||
+        (connect(client->sock, (struct sockaddr*)&client->addr, sizeof(client->addr)) != 0 &&
+         errno != EINPROGRESS)) {
+        printf("Stratum: connect failed\n");
+        stratum_disconnect(client);
+        return -1;
+    }
+    client->connecting = 1;
+    client->connect_deadline_us = miner_time_us() + STRATUM_CONNECT_TIMEOUT_US;
+    return 0;
+}
+
+// Check on a connect in progress without waiting. Returns 1 once the
+// session has started, 0 while still connecting, -1 if it failed.
+static int stratum_finish_connect(stratum_client_t* client) {
+    struct timeval zero = { 0, 0 };
+    fd_set writable;
+    int error = 0;
+    socklen_t error_len = sizeof(error);
+    
+    FD_ZERO(&writable);
+    FD_SET(client->sock, &writable);
+    if (select(client->sock + 1, NULL, &writable, NULL, &zero) == 0) {
+        if (miner_time_us() < client->connect_deadline_us) {
+            return 0;
+        }
+        printf("Stratum: connect timed out\n");
+        stratum_disconnect(client);
+        return -1;
+    }
+    if (getsockopt(client->sock, SOL_SOCKET, SO_ERROR, &error, &error_len) != 0 || error != 0) {
+        printf("Stratum: connect failed\n");
+        stratum_disconnect(client);
+        return -1;
+    }
+    return (stratum_start_session(client) == 0) ? 1 : -1;
+}
+
+void stratum_init(stratum_client_t* client, const char* host, const char* port,
+                  const char* worker, const char* password, job_queue_t* queue) {
+    memset(client, 0, sizeof(*client));
+    client->sock = -1;
+    client->next_id = 1;
+    client->difficulty = 1.0;
+    client->version_mask_request = VERSION_ROLL_MASK;
+    client->queue = queue;
+    snprintf(client->host, sizeof(client->host), "%s", host);
+    snprintf(client->port, sizeof(client->port), "%s", port);
+    snprintf(client->worker, sizeof(client->worker), "%s", worker);
+    snprintf(client->password, sizeof(client->password), "%s", password);
+}
+
+// mining.notify: build a work template and, on clean_jobs, replace all
+// queued and in-flight work with it. The template is parsed aside and only
+// takes its slot once complete, so a malformed notify leaves the older
+// template in that slot (and its in-flight shares) intact.
+static void stratum_handle_notify(stratum_client_t* client, const char* params) {
+    char hex[MAX_COINBASE_PART * 2 + 1];
+    char name[STRATUM_JOB_NAME_LEN];
+    job_template_t parsed;
+    job_template_t* tmpl = &parsed;
+    uint32_t id = client->template_count;
+    uint32_t slot = id % STRATUM_TEMPLATE_SLOTS;
+    
+    memset(tmpl, 0, sizeof(*tmpl));
+    tmpl->template_id = id;
+    
+    if (json_string(json_index(params, 0), name, sizeof(name)) != 0) {
+        return;
+    }
+    
+    // prevhash arrives with each 32-bit word byte-swapped
+    if (json_string(json_index(params, 1), hex, sizeof(hex)) != 0 ||
+        hex_decode(hex, tmpl->prev_block, 32) != 32) {
+        return;
+    }
+    for (int i = 0; i < 32; i += 4) {
+        uint8_t t0 = tmpl->prev_block[i], t1 = tmpl->prev_block[i + 1];
+        tmpl->prev_block[i] = tmpl->prev_block[i + 3];
+        tmpl->prev_block[i + 1] = tmpl->prev_block[i + 2];
+        tmpl->prev_block[i + 2] = t1;
+        tmpl->prev_block[i + 3] = t0;
+    }
+    
+    int len;
+    if (json_string(json_index(params, 2), hex, sizeof(hex)) != 0 ||
+        (len = hex_decode(hex, tmpl->coinbase1, MAX_COINBASE_PART)) < 0) {
+        return;
+    }
+    tmpl->coinbase1_len = (uint32_t)len;
+    if (json_string(json_index(params, 3), hex, sizeof(hex)) != 0 ||
+        (len = hex_decode(hex, tmpl->coinbase2, MAX_COINBASE_PART)) < 0) {
+        return;
+    }
+    tmpl->coinbase2_len = (uint32_t)len;
+    
+    const char* branches = json_index(params, 4);
+    const char* branch;
+    while (branches && (branch = json_index(branches, (int)tmpl->merkle_count)) != NULL) {
+        if (tmpl->merkle_count >= MAX_MERKLE_BRANCHES ||
+            json_string(branch, hex, sizeof(hex)) != 0 ||
+            hex_decode(hex, tmpl->merkle_branch[tmpl->merkle_count], 32) != 32) {
+            return;
+        }
+        tmpl->merkle_count++;
+    }
+    
+    if (json_string(json_index(params, 5), hex, sizeof(hex)) != 0) {
+        return;
+    }
+    tmpl->version = (uint32_t)strtoul(hex, NULL, 16);
+    if (json_string(json_index(params, 6), hex, sizeof(hex)) != 0) {
+        return;
+    }
+    tmpl->bits = (uint32_t)strtoul(hex, NULL, 16);
+    if (json_string(json_index(params, 7), hex, sizeof(hex)) != 0) {
+        return;
+    }
+    tmpl->ntime = (uint32_t)strtoul(hex, NULL, 16);
+    int clean = json_is_true(json_index(params, 8));
+    
+    memcpy(tmpl->extranonce1, client->extranonce1, client->extranonce1_len);
+    tmpl->extranonce1_len = client->extranonce1_len;
+    tmpl->extranonce2_len = client->extranonce2_len;
+    tmpl->ntime_roll_max = NTIME_ROLL_MAX;
+    tmpl->version_mask = client->version_mask;
+    difficulty_to_target(client->difficulty, tmpl->target);
+    
+    tmpl = &client->templates[slot];
+    *tmpl = parsed;
+    memcpy(client->job_names[slot], name, sizeof(name));
+    client->template_count++;
+    
+    // Always roll the newest template; on clean_jobs it starts a new
+    // generation, so older work is aborted and its late shares dropped
+    if (clean || !client->have_template) {
+        mining_new_generation();
+    }
+    uint32_t next_job_id = client->roller.next_job_id;
+    job_roller_init(&client->roller, tmpl);
+    client->roller.next_job_id = next_job_id;
+    client->have_template = 1;
+    
+    printf("Stratum: job %s%s (bits 0x%08X, %u branches)\n", client->job_names[slot],
+           clean ? " [clean]" : "", tmpl->bits, tmpl->merkle_count);
+}
+
+// Answer to a mining.submit: settle its outstanding request
+static void stratum_handle_share_result(stratum_client_t* client, uint32_t id,
+                                        const char* line, const char* result) {
+    share_request_t* request = NULL;
+    
+    for (uint32_t i = 0; i < SHARE_OUTSTANDING; i++) {
+        if (client->requests[i].id == id) {
+            request = &client->requests[i];
+        }
+    }
+    if (request == NULL) {
+        return;  // Not ours, or settled by an earlier answer
+    }
+    request->id = 0;
+    
+    int accepted = json_is_true(result);
+    telemetry_share_result(request->share.job.template_id, accepted);
+    if (accepted) {
+        client->shares_accepted++;
+        printf("Stratum: share accepted (%u/%u)\n", client->shares_accepted,
+               client->shares_submitted);
+    } else {
+        // error is [code, "message", data]
+        char reason[64] = "";
+        const char* error = json_get(line, "error");
+        if (error) {
+            json_string(json_index(error, 1), reason, sizeof(reason));
+        }
+        client->shares_rejected++;
+        printf("Stratum: share rejected (%u/%u)%s%s\n", client->shares_rejected,
+               client->shares_submitted, reason[0] ? ": " : "", reason);
+    }
+}
+
+static void stratum_handle_line(stratum_client_t* client, const char* line) {
+    const char* method = json_get(line, "method");
+    const char* params = json_get(line, "params");
+    
+    if (method) {
+        char name[64];
+        if (json_string(method, name, sizeof(name)) != 0 || !params) {
+            return;
+        }
+        if (strcmp(name, "mining.notify") == 0) {
+            stratum_handle_notify(client, params);
+        } else if (strcmp(name, "mining.set_difficulty") == 0) {
+            const char* value = json_index(params, 0);
+            if (value) {
+                client->difficulty = strtod(value, NULL);
+                printf("Stratum: share difficulty %.3f\n", client->difficulty);
+            }
+        } else if (strcmp(name, "mining.set_version_mask") == 0) {
+            // Applies from the next notify
+            char hex[16];
+            if (json_string(json_index(params, 0), hex, sizeof(hex)) == 0) {
+                client->version_mask = (uint32_t)strtoul(hex, NULL, 16) & client->version_mask_request;
+                printf("Stratum: version mask %08x\n", client->version_mask);
+            }
+        }
+        return;
+    }
+    
+    // Response to one of our requests
+    const char* id_value = json_get(line, "id");
+    const char* result = json_get(line, "result");
+    if (json_is_null(id_value)) {
+        return;
+    }
+    uint32_t id = (uint32_t)strtoul(id_value, NULL, 10);
+    
+    if (id == client->subscribe_id) {
+        char hex[MAX_EXTRANONCE_SIZE * 2 + 1];
+        const char* size = json_index(result, 2);
+        int len;
+        if (json_string(json_index(result, 1), hex, sizeof(hex)) != 0 || !size ||
+            (len = hex_decode(hex, client->extranonce1, MAX_EXTRANONCE_SIZE)) < 0) {
+            printf("Stratum: bad subscribe response\n");
+            return;
+        }
+        client->extranonce1_len = (uint32_t)len;
+        client->extranonce2_len = (uint32_t)strtoul(size, NULL, 10);
+        if (client->extranonce2_len > MAX_EXTRANONCE_SIZE) {
+            client->extranonce2_len = MAX_EXTRANONCE_SIZE;
+        }
+        printf("Stratum: subscribed, extranonce1 %s, extranonce2 %u bytes\n",
+               hex, client->extranonce2_len);
+    } else if (id == client->authorize_id) {
+        client->authorized = json_is_true(result);
+        printf("Stratum: worker %s %s\n", client->worker,
+               client->authorized ? "authorized" : "rejected");
+    } else if (client->suggest_id && id == client->suggest_id) {
+        // Advisory only; mining.set_difficulty carries the pool's answer
+    } else if (client->configure_id && id == client->configure_id) {
+        char hex[16];
+        if (json_is_true(json_get(result, "version-rolling")) &&
+            json_string(json_get(result, "version-rolling.mask"), hex, sizeof(hex)) == 0) {
+            client->version_mask = (uint32_t)strtoul(hex, NULL, 16) & client->version_mask_request;
+        }
+        printf("Stratum: version rolling %s (mask %08x)\n",
+               client->version_mask ? "enabled" : "off", client->version_mask);
+    } else {
+        stratum_handle_share_result(client, id, line, result);
+    }
+}
+
+// Finish a pending connect, flush the TX buffer, then drain the socket
+// without blocking and handle complete lines. Returns -1 if the
+// connection was lost.
+int stratum_poll(stratum_client_t* client) {
+    if (client->connecting && stratum_finish_connect(client) <= 0) {
+        return client->connecting ? 0 : -1;
+    }
+    if (!client->connected) {
+        return -1;
+    }
+    if (stratum_flush(client) != 0) {
+        printf("Stratum: connection lost\n");
+        stratum_disconnect(client);
+        return -1;
+    }
+    
+    while (1) {
+        int n = recv(client->sock, client->rx + client->rx_len,
+                     STRATUM_RX_SIZE - 1 - client->rx_len, 0);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            printf("Stratum: connection lost\n");
+            stratum_disconnect(client);
+            return -1;
+        }
+        if (n < 0) {
+            return 0;  // Nothing more to read
+        }
+        client->rx_len += (uint32_t)n;
+        client->rx[client->rx_len] = '\0';
+        
+        char* line = client->rx;
+        char* end;
+        while ((end = strchr(line, '\n')) != NULL) {
+            *end = '\0';
+            stratum_handle_line(client, line);
+            line = end + 1;
+        }
+        
+        // Keep the partial tail; drop a line too long to ever fit
+        client->rx_len -= (uint32_t)(line - client->rx);
+        memmove(client->rx, line, client->rx_len);
+        if (client->rx_len >= STRATUM_RX_SIZE - 1) {
+            client->rx_len = 0;
+        }
+    }
+}
+
+// Send mining.submit for a share rolled from one of our templates
+static int stratum_submit(stratum_client_t* client, const share_request_t* request) {
+    const mining_job_t* job = &request->share.job;
+    uint32_t nonce = request->share.nonce;
+    uint32_t slot = job->template_id % STRATUM_TEMPLATE_SLOTS;
+    char extranonce2[MAX_EXTRANONCE_SIZE * 2 + 1];
+    uint8_t raw[MAX_EXTRANONCE_SIZE];
+    char line[STRATUM_TX_SIZE];
+    
+    if (!client->connected || client->templates[slot].template_id != job->template_id) {
+        printf("Stratum: dropping share for expired job\n");
+        return -1;
+    }
+    
+    encode_extranonce2(job->extranonce2, client->templates[slot].extranonce2_len, raw);
+    hex_encode(raw, client->templates[slot].extranonce2_len, extranonce2);
+    
+    // With version rolling the rolled bits go in a sixth parameter
+    uint32_t version_mask = client->templates[slot].version_mask;
+    char version_bits[16] = "";
+    if (version_mask) {
+        snprintf(version_bits, sizeof(version_bits), ",\"%08x\"", job->version & version_mask);
+    }
+    
+    snprintf(line, sizeof(line),
+             "{\"id\":%u,\"method\":\"mining.submit\",\"params\":"
+             "[\"%s\",\"%s\",\"%s\",\"%08x\",\"%08x\"%s]}\n",
+             request->id, client->worker, client->job_names[slot],
+             extranonce2, job->ntime, nonce, version_bits);
+    if (stratum_send(client, line) != 0) {
+        stratum_disconnect(client);
+        return -1;
+    }
+    return 0;
+}
+
+// Whether a share was already submitted; otherwise remember it
+static int stratum_seen_share(stratum_client_t* client, const share_t* share) {
+    uint32_t count = client->recent_count < SHARE_DEDUP_SIZE ? client->recent_count : SHARE_DEDUP_SIZE;
+    
+    for (uint32_t i = 0; i < count; i++) {
+        if (client->recent[i][0] == share->job.job_id && client->recent[i][1] == share->nonce) {
+            return 1;
+        }
+    }
+    uint32_t slot = client->recent_count++ % SHARE_DEDUP_SIZE;
+    client->recent[slot][0] = share->job.job_id;
+    client->recent[slot][1] = share->nonce;
+    return 0;
+}
+
+// Submitter pass: retry or give up on unanswered requests, then send
+// queued shares while request slots are free
+static void stratum_submit_pending(stratum_client_t* client) {
+    share_queue_t* queue = &client->share_queue;
+    uint64_t now = miner_time_us();
+    
+    uint32_t dropped = __atomic_load_n(&queue->dropped, __ATOMIC_RELAXED);
+    if (dropped != client->dropped_reported) {
+        printf("Stratum: %u shares dropped, submit queue full\n", dropped - client->dropped_reported);
+        client->dropped_reported = dropped;
+    }
+    
+    for (uint32_t i = 0; i < SHARE_OUTSTANDING && client->connected; i++) {
+        share_request_t* request = &client->requests[i];
+        if (request->id == 0 || now - request->sent_us < SHARE_RETRY_US) {
+            continue;
+        }
+        if (request->retries++ >= SHARE_MAX_RETRIES) {
+            printf("Stratum: share %08x unanswered, giving up\n", request->share.nonce);
+            request->id = 0;
+            client->shares_lost++;
+            continue;
+        }
+        // Same id: whichever answer comes first settles it
+        request->sent_us = now;
+        stratum_submit(client, request);
+    }
+    
+    for (uint32_t i = 0; i < SHARE_OUTSTANDING && client->connected; i++) {
+        share_request_t* request = &client->requests[i];
+        if (request->id != 0) {
+            continue;
+        }
+        
+        // Pop the next share still worth sending
+        uint32_t generation = __atomic_load_n(&mining_job_generation, __ATOMIC_ACQUIRE);
+        int found = 0;
+        while (!found && share_queue_pop(queue, &request->share) == 0) {
+            if (job_is_stale(&request->share.job, generation)) {
+                client->shares_stale++;
+            } else if (stratum_seen_share(client, &request->share)) {
+                client->shares_duplicate++;
+            } else {
+                found = 1;
+            }
+        }
+        if (!found) {
+            break;
+        }
+        
+        request->id = client->next_id++;
+        request->sent_us = now;
+        request->retries = 0;
+        if (stratum_submit(client, request) != 0) {
+            request->id = 0;  // Dropped (expired job) or disconnected
+            continue;
+        }
+        client->shares_submitted++;
+    }
+}
+
+// Refill hook: service the pool connection, then top up the queue. Only
+// this hook (on the prep thread when there is one) touches the socket and
+// templates; the device loop hands shares over through share_queue.
+void stratum_refill(job_queue_t* queue, void* ctx) {
+    stratum_client_t* client = (stratum_client_t*)ctx;
+    
+    if (!client->connected && !client->connecting) {
+        if (client->reconnect_wait > 0) {
+            client->reconnect_wait--;
+            return;
+        }
+        if (stratum_connect(client) != 0) {
+            return;
+        }
+        // Shares found since the last session ended are void
+        client->shares_lost += share_queue_discard(&client->share_queue);
+    }
+    
+    stratum_poll(client);
+    stratum_submit_pending(client);
+    
+    // The roller is only touched from here and from notify handling
+    if (client->have_template) {
+        roller_refill(queue, &client->roller);
+    }
+}
+
+// Share hook: queue golden nonces for the submitter; never blocks
+void stratum_share_found(const mining_job_t* job, uint32_t nonce, void* ctx) {
+    stratum_client_t* client = (stratum_client_t*)ctx;
+    share_queue_push(&client->share_queue, job, nonce);
+}
+
+// Mine for a Stratum v1 pool until mining_stop_requested is set.
+// difficulty > 0 asks the pool for that share difficulty; version_mask
+// is the version rolling mask to request (0 disables it).
+void mining_loop_stratum(const char* host, const char* port, const char* worker,
+                         const char* password, double difficulty, uint32_t version_mask) {
+    static stratum_client_t client;
+    static job_queue_t queue;
+    
+    job_queue_init(&queue);
+    stratum_init(&client, host, port, worker, password, &queue);
+    client.suggested_difficulty = difficulty;
+    client.version_mask_request = version_mask;
+    
+    mining_hooks_t hooks = { stratum_refill, stratum_share_found, &client };
+    mining_loop_queue(&queue, &hooks);
+    
+    stratum_disconnect(&client);
+    printf("Stratum: %u shares submitted, %u accepted, %u rejected, "
+           "%u duplicate, %u stale, %u lost\n",
+           client.shares_submitted, client.shares_accepted, client.shares_rejected,
+           client.shares_duplicate, client.shares_stale, client.shares_lost);
+}
+#endif
+
+#ifdef MINER_USE_CLUSTER
+// Cluster protocol. Boards ask the coordinator for jobs as their queue
+// runs low; each job is a compact descriptor (midstate, residual,
+// target) covering its whole nonce space and goes to exactly one board,
+// so one roller over one pool session partitions the version/ntime/
+// extranonce2 space and no two boards hash the same header. Boards send
+// golden nonces back by job id and resend them until acknowledged; the
+// coordinator verifies them and feeds them to its share pipeline. Every
+// message carries the coordinator's job generation, so a clean_jobs
+// reaches the boards with the next message (a JOBS with no jobs if
+// need be). All fields are 32-bit little-endian words.
+
+#ifndef MINER_CLUSTER_PORT
+#define MINER_CLUSTER_PORT 3390
+#endif
+
+#define CLUSTER_MAGIC       0x464D434C  // "LCMF"
+#define CLUSTER_MSG_REQUEST 1  // Board: count = jobs wanted
+#define CLUSTER_MSG_JOBS    2  // Coordinator: count job descriptors
+#define CLUSTER_MSG_RESULTS 3  // Board: count golden nonces
+#define CLUSTER_MSG_ACK     4  // Coordinator: the golden nonces it took
+#define CLUSTER_MSG_STATUS  5  // Board: telemetry snapshot
+#define CLUSTER_MAX_ITEMS   16  // Per datagram, keeps JOBS under one MTU
+
+// Jobs a board keeps queued ahead of its cores
+#ifndef CLUSTER_BOARD_QUEUE
+#define CLUSTER_BOARD_QUEUE 4
+#endif
+#ifndef CLUSTER_REQUEST_US
+#define CLUSTER_REQUEST_US 100000    // Minimum gap between job requests
+#endif
+#ifndef CLUSTER_RETRY_US
+#define CLUSTER_RETRY_US 1000000     // Resend unacknowledged results
+#endif
+#ifndef CLUSTER_STATUS_US
+#define CLUSTER_STATUS_US 5000000
+#endif
+#ifndef CLUSTER_BOARD_TIMEOUT_US
+#define CLUSTER_BOARD_TIMEOUT_US 30000000
+#endif
+#ifndef CLUSTER_MAX_BOARDS
+#define CLUSTER_MAX_BOARDS 32
+#endif
+#define CLUSTER_PENDING 32  // Results a board keeps until acknowledged
+
+// Dispatched jobs the coordinator remembers to turn results into shares
+#ifndef CLUSTER_JOB_HISTORY
+#define CLUSTER_JOB_HISTORY 1024
+#endif
+
+typedef struct {
+    uint32_t magic;
+    uint32_t type;
+    uint32_t count;
+    uint32_t generation;  // Coordinator job generation (boards: last seen)
+} cluster_header_t;
+
+typedef struct {
+    uint32_t job_id;
+    mining_params_t params;
+} cluster_job_wire_t;
+
+typedef struct {
+    uint32_t job_id;
+    uint32_t nonce;
+} cluster_result_wire_t;
+
+typedef struct {
+    uint32_t cores;
+    uint32_t hashrate_khs;
+    uint32_t shares_found;
+    uint32_t hw_valid;
+    uint32_t hw_invalid;
+    uint32_t queued;
+} cluster_status_wire_t;
+
+typedef struct {
+    cluster_header_t header;
+    union {
+        cluster_job_wire_t jobs[CLUSTER_MAX_ITEMS];
+        cluster_result_wire_t results[CLUSTER_MAX_ITEMS];
+        cluster_status_wire_t status;
+    } body;
+} cluster_msg_t;
+
+_Static_assert(sizeof(cluster_msg_t) <= 1472, "cluster messages must fit one datagram");
+
+// Fill in the header and put the message in wire byte order; returns
+// the length to send
+static size_t cluster_encode(cluster_msg_t* msg, uint32_t type, uint32_t count, size_t item_size,
+                             uint32_t generation) {
+    size_t len = sizeof(msg->header) + count * item_size;
+    uint32_t* words = (uint32_t*)msg;
+    
+    msg->header.magic = CLUSTER_MAGIC;
+    msg->header.type = type;
+    msg->header.count = count;
+    msg->header.generation = generation;
+    for (size_t i = 0; i < len / 4; i++) {
+        words[i] = host_to_le32(words[i]);
+    }
+    return len;
+}
+
+// Check and convert a received message in place; returns 0 if usable
+static int cluster_decode(cluster_msg_t* msg, int len) {
+    uint32_t* words = (uint32_t*)msg;
+    size_t item_size;
+    
+    if (len < (int)sizeof(msg->header)) {
+        return -1;
+    }
+    for (int i = 0; i < len / 4; i++) {
+        words[i] = le32_to_host(words[i]);
+    }
+    switch (msg->header.type) {
+        case CLUSTER_MSG_JOBS:    item_size = sizeof(cluster_job_wire_t); break;
+        case CLUSTER_MSG_RESULTS:
+        case CLUSTER_MSG_ACK:     item_size = sizeof(cluster_result_wire_t); break;
+        case CLUSTER_MSG_STATUS:  item_size = sizeof(cluster_status_wire_t); break;
+        default:                  item_size = 0; break;
+    }
+    if (msg->header.magic != CLUSTER_MAGIC || msg->header.count > CLUSTER_MAX_ITEMS ||
+        (size_t)len < sizeof(msg->header) + msg->header.count * item_size) {
+        return -1;
+    }
+    return 0;
+}
+
+// Board side: runs from the refill hook of the board's queue-fed loop
+typedef struct {
+    int sock;                      // Connected to the coordinator
+    share_queue_t shares;          // Device loop -> refill hook
+    cluster_result_wire_t pending[CLUSTER_PENDING];  // Sent, not acknowledged
+    uint64_t pending_sent_us[CLUSTER_PENDING];
+    uint32_t pending_count;
+    uint32_t generation;           // Coordinator generation last seen
+    int have_generation;
+    uint64_t last_request_us;
+    uint64_t last_status_us;
+} cluster_board_t;
+
+// Open a UDP socket to the coordinator. Returns 0 on success.
+int cluster_board_init(cluster_board_t* board, const char* host, const char* port) {
+    struct addrinfo hints;
+    struct addrinfo* result = NULL;
+    
+    memset(board, 0, sizeof(*board));
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(host, port, &hints, &result) != 0 || result == NULL) {
+        printf("Cluster: cannot resolve %s\n", host);
+        return -1;
+    }
+    board->sock = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+    if (board->sock < 0 || connect(board->sock, result->ai_addr, result->ai_addrlen) != 0) {
+        printf("Cluster: cannot reach %s:%s\n", host, port);
+        freeaddrinfo(result);
+        if (board->sock >= 0) {
+            cluster_close(board->sock);
+        }
+        return -1;
+    }
+    freeaddrinfo(result);
+    fcntl(board->sock, F_SETFL, fcntl(board->sock, F_GETFL, 0) | O_NONBLOCK);
+    return 0;
+}
+
+// Every coordinator message carries its generation. A newer one starts a
+// new local generation, so the device loop drops the older work. Returns
+// -1 if the message predates the generation already seen.
+static int cluster_board_check_generation(cluster_board_t* board, const cluster_msg_t* msg) {
+    int32_t age = (int32_t)(msg->header.generation - board->generation);
+    
+    if (board->have_generation && age < 0) {
+        return -1;  // Overtaken by a clean_jobs
+    }
+    if (board->have_generation && age > 0) {
+        mining_new_generation();
+        board->last_request_us = 0;  // Everything queued is stale: ask now
+    }
+    board->generation = msg->header.generation;
+    board->have_generation = 1;
+    return 0;
+}
+
+static void cluster_board_take_jobs(job_queue_t* queue, const cluster_msg_t* msg) {
+    for (uint32_t i = 0; i < msg->header.count; i++) {
+        mining_job_t job;
+        memset(&job, 0, sizeof(job));
+        job.job_id = msg->body.jobs[i].job_id;
+        job.params = msg->body.jobs[i].params;
+        job.generation = __atomic_load_n(&mining_job_generation, __ATOMIC_ACQUIRE);
+        if (job_queue_push(queue, &job) != 0) {
+            break;
+        }
+    }
+}
+
+static void cluster_board_take_ack(cluster_board_t* board, const cluster_msg_t* msg) {
+    for (uint32_t i = 0; i < msg->header.count; i++) {
+        for (uint32_t p = 0; p < board->pending_count; p++) {
+            if (board->pending[p].job_id == msg->body.results[i].job_id &&
+                board->pending[p].nonce == msg->body.results[i].nonce) {
+                board->pending_count--;
+                board->pending[p] = board->pending[board->pending_count];
+                board->pending_sent_us[p] = board->pending_sent_us[board->pending_count];
+                break;
+            }
+        }
+    }
+}
+
+// Refill hook: take jobs and acknowledgements, send golden nonces, ask
+// for work when the queue runs low and report telemetry now and then
+void cluster_board_refill(job_queue_t* queue, void* ctx) {
+    cluster_board_t* board = (cluster_board_t*)ctx;
+    uint64_t now = miner_time_us();
+    cluster_msg_t msg;
+    int len;
+    
+    while ((len = recv(board->sock, &msg, sizeof(msg), 0)) > 0) {
+        if (cluster_decode(&msg, len) != 0) {
+            continue;
+        }
+        int current = cluster_board_check_generation(board, &msg) == 0;
+        if (msg.header.type == CLUSTER_MSG_JOBS && current) {
+            cluster_board_take_jobs(queue, &msg);
+        } else if (msg.header.type == CLUSTER_MSG_ACK) {
+            cluster_board_take_ack(board, &msg);
+        }
+    }
+    
+    // New golden nonces plus any whose acknowledgement is overdue
+    uint32_t count = 0;
+    for (uint32_t p = 0; p < board->pending_count && count < CLUSTER_MAX_ITEMS; p++) {
+        if (now - board->pending_sent_us[p] >= CLUSTER_RETRY_US) {
+            board->pending_sent_us[p] = now;
+            msg.body.results[count++] = board->pending[p];
+        }
+    }
+    share_t share;
+    while (count < CLUSTER_MAX_ITEMS && board->pending_count < CLUSTER_PENDING &&
+           share_queue_pop(&board->shares, &share) == 0) {
+        cluster_result_wire_t* result = &board->pending[board->pending_count];
+        result->job_id = share.job.job_id;
+        result->nonce = share.nonce;
+        board->pending_sent_us[board->pending_count++] = now;
+        msg.body.results[count++] = *result;
+    }
+    if (count > 0) {
+        send(board->sock, &msg, cluster_encode(&msg, CLUSTER_MSG_RESULTS, count,
+                                               sizeof(cluster_result_wire_t),
+                                               board->generation), 0);
+    }
+    
+    uint32_t queued = job_queue_count(queue);
+    if (queued < CLUSTER_BOARD_QUEUE && now - board->last_request_us >= CLUSTER_REQUEST_US) {
+        send(board->sock, &msg, cluster_encode(&msg, CLUSTER_MSG_REQUEST,
+                                               CLUSTER_BOARD_QUEUE - queued, 0,
+                                               board->generation), 0);
+        board->last_request_us = now;
+    }
+    
+    if (now - board->last_status_us >= CLUSTER_STATUS_US) {
+        cluster_status_wire_t* status = &msg.body.status;
+        status->cores = miner_core_count;
+        status->hashrate_khs = (uint32_t)(telemetry_total_hashrate() / 1e3);
+        status->shares_found = miner_telemetry.shares_found;
+        status->hw_valid = miner_hw_stats.valid;
+        status->hw_invalid = miner_hw_stats.invalid;
+        status->queued = queued;
+        send(board->sock, &msg, cluster_encode(&msg, CLUSTER_MSG_STATUS, 1,
+                                               sizeof(cluster_status_wire_t),
+                                               board->generation), 0);
+        board->last_status_us = now;
+    }
+}
+
+// Share hook: queue golden nonces for the refill hook; never blocks
+void cluster_board_share_found(const mining_job_t* job, uint32_t nonce, void* ctx) {
+    cluster_board_t* board = (cluster_board_t*)ctx;
+    share_queue_push(&board->shares, job, nonce);
 }
 
-// Write TARGET to FPGA
-void write_target(uint32_t* target) {
-    printf("Writing TARGET...\n");
-    for (int i = 0; i < 8; i++) {
-        write_register(BANK_3_OFFSET + (i * 4), target[i]);
-        printf("  TARGET[%d] = 0x%08X\n", i, target[i]);
+// Mine jobs handed out by a coordinator until mining_stop_requested is set
+void mining_loop_board(const char* host, const char* port) {
+    static cluster_board_t board;
+    static job_queue_t queue;
+    
+    if (cluster_board_init(&board, host, port) != 0) {
+        return;
     }
+    printf("Cluster: board of coordinator %s:%s\n", host, port);
+    job_queue_init(&queue);
+    
+    mining_hooks_t hooks = { cluster_board_refill, cluster_board_share_found, &board };
+    mining_loop_queue(&queue, &hooks);
+    
+    cluster_close(board.sock);
 }
 
-// Start mining
-void start_mining(void) {
-    printf("Starting mining...\n");
-    write_register(CTRL_START, 1);
-}
+#ifdef MINER_USE_STRATUM
+// Coordinator side: one pool session, jobs rolled into a local queue and
+// handed to boards on request
 
-// Stop mining
-void stop_mining(void) {
-    printf("Stopping mining...\n");
-    write_register(CTRL_SRST, 1);
-    usleep(1000); // Small delay
-    write_register(CTRL_SRST, 0);
-}
+typedef struct {
+    struct sockaddr_in addr;
+    int active;
+    uint64_t last_seen_us;
+    uint32_t generation;           // Coordinator generation the board last saw
+    uint32_t jobs_sent;
+    uint32_t results;
+    uint32_t results_bad;          // Failed verification or unknown job
+    cluster_status_wire_t status;  // Last STATUS from the board
+} cluster_peer_t;
 
-// Check if golden nonce was found
-int check_found(void) {
-    uint32_t found = read_register(STATUS_FOUND);
-    return (found & 0x1);
+typedef struct {
+    int sock;
+    stratum_client_t* pool;
+    job_queue_t* queue;
+    mining_job_t sent[CLUSTER_JOB_HISTORY];  // job_id % CLUSTER_JOB_HISTORY
+    cluster_peer_t peers[CLUSTER_MAX_BOARDS];
+    uint32_t generation;           // Last generation announced
+    uint64_t last_report_us;
+} cluster_coordinator_t;
+
+// Listen for boards on UDP port. Returns 0 on success.
+int cluster_coordinator_init(cluster_coordinator_t* coord, uint32_t port,
+                             stratum_client_t* pool, job_queue_t* queue) {
+    struct sockaddr_in addr;
+    
+    memset(coord, 0, sizeof(*coord));
+    coord->pool = pool;
+    coord->queue = queue;
+    coord->generation = __atomic_load_n(&mining_job_generation, __ATOMIC_ACQUIRE);
+    coord->last_report_us = miner_time_us();
+    
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((uint16_t)port);
+    coord->sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (coord->sock < 0 || bind(coord->sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        printf("Cluster: cannot listen on UDP port %u\n", port);
+        if (coord->sock >= 0) {
+            cluster_close(coord->sock);
+        }
+        return -1;
+    }
+    fcntl(coord->sock, F_SETFL, fcntl(coord->sock, F_GETFL, 0) | O_NONBLOCK);
+    return 0;
 }
 
-// Get golden nonce if found
-uint32_t get_golden_nonce(void) {
-    return read_register(STATUS_GOLDEN_NONCE);
+// Board record for a sender, registering new boards in a free slot
+static cluster_peer_t* cluster_find_peer(cluster_coordinator_t* coord,
+                                         const struct sockaddr_in* addr, uint64_t now) {
+    cluster_peer_t* free_peer = NULL;
+    
+    for (uint32_t i = 0; i < CLUSTER_MAX_BOARDS; i++) {
+        cluster_peer_t* peer = &coord->peers[i];
+        if (!peer->active) {
+            if (free_peer == NULL) {
+                free_peer = peer;
+            }
+        } else if (peer->addr.sin_addr.s_addr == addr->sin_addr.s_addr &&
+                   peer->addr.sin_port == addr->sin_port) {
+            peer->last_seen_us = now;
+            return peer;
+        }
+    }
+    if (free_peer == NULL) {
+        return NULL;
+    }
+    memset(free_peer, 0, sizeof(*free_peer));
+    free_peer->addr = *addr;
+    free_peer->active = 1;
+    free_peer->last_seen_us = now;
+    printf("Cluster: board %u joined (port %u)\n", (uint32_t)(free_peer - coord->peers),
+           ntohs(addr->sin_port));
+    return free_peer;
 }
 
-// Get current nonce being processed
-uint32_t get_current_nonce(void) {
-    write_register(CTRL_CURRENT_HASH_REQ, 1);
-    usleep(1000); // Small delay for CDC
-    write_register(CTRL_CURRENT_HASH_REQ, 0);
-    return read_register(STATUS_CURRENT_NONCE);
+static void cluster_send_to(cluster_coordinator_t* coord, const cluster_peer_t* peer,
+                            cluster_msg_t* msg, size_t len) {
+    sendto(coord->sock, msg, len, 0, (const struct sockaddr*)&peer->addr, sizeof(peer->addr));
 }
 
-// Print current mining status
-void print_mining_status(void) {
-    uint32_t current_nonce = get_current_nonce();
-    uint32_t found = read_register(STATUS_FOUND);
-    uint32_t not_found = read_register(STATUS_NOT_FOUND);
+// Hand up to count fresh jobs from the queue to a board
+static void cluster_send_jobs(cluster_coordinator_t* coord, cluster_peer_t* peer, uint32_t count) {
+    uint32_t generation = __atomic_load_n(&mining_job_generation, __ATOMIC_ACQUIRE);
+    cluster_msg_t msg;
+    uint32_t n = 0;
+    mining_job_t job;
     
-    printf("=== Mining Status ===\n");
-    printf("Current Nonce: 0x%08X (%u)\n", current_nonce, current_nonce);
-    printf("Found: %s\n", found ? "YES" : "NO");
-    printf("Not Found: %s\n", not_found ? "YES" : "NO");
+    while (n < count && n < CLUSTER_MAX_ITEMS && job_queue_pop(coord->queue, &job) == 0) {
+        if (job_is_stale(&job, generation)) {
+            continue;
+        }
+        coord->sent[job.job_id % CLUSTER_JOB_HISTORY] = job;
+        msg.body.jobs[n].job_id = job.job_id;
+        msg.body.jobs[n].params = job.params;
+        n++;
+    }
+    if (n > 0) {
+        peer->jobs_sent += n;
+        cluster_send_to(coord, peer, &msg, cluster_encode(&msg, CLUSTER_MSG_JOBS, n,
+                                                          sizeof(cluster_job_wire_t),
+                                                          generation));
+    }
+}
+
+// Verify a board's golden nonces, pass the good ones to the pool's share
+// pipeline and acknowledge them all so the board stops resending
+static void cluster_take_results(cluster_coordinator_t* coord, cluster_peer_t* peer,
+                                 cluster_msg_t* msg) {
+    uint32_t count = msg->header.count;
     
-    if (found) {
-        uint32_t golden_nonce = get_golden_nonce();
-        printf("Golden Nonce: 0x%08X (%u)\n", golden_nonce, golden_nonce);
+    for (uint32_t i = 0; i < count; i++) {
+        const cluster_result_wire_t* result = &msg->body.results[i];
+        const mining_job_t* job = &coord->sent[result->job_id % CLUSTER_JOB_HISTORY];
+        if (job->job_id != result->job_id || !job_nonce_valid(&job->params, result->nonce)) {
+            peer->results_bad++;
+            continue;
+        }
+        peer->results++;
+        stratum_share_found(job, result->nonce, coord->pool);
     }
-    printf("===================\n");
+    cluster_send_to(coord, peer, msg, cluster_encode(msg, CLUSTER_MSG_ACK, count,
+                                                     sizeof(cluster_result_wire_t),
+                                                     coord->generation));
 }
 
-// Set a very easy difficulty for testing (will find nonces quickly)
-void set_test_difficulty(void) {
-    uint32_t easy_target[8] = {
-        0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF,
-        0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0x000000FF  // Very easy target
-    };
-    write_target(easy_target);
-    printf("Set test difficulty (very easy target)\n");
+static void cluster_report(cluster_coordinator_t* coord, uint64_t now) {
+    const stratum_client_t* pool = coord->pool;
+    double total = 0.0;
+    
+    for (uint32_t i = 0; i < CLUSTER_MAX_BOARDS; i++) {
+        const cluster_peer_t* peer = &coord->peers[i];
+        if (!peer->active) {
+            continue;
+        }
+        uint32_t hw_total = peer->status.hw_valid + peer->status.hw_invalid;
+        total += peer->status.hashrate_khs / 1e3;
+        printf("[cluster] board %u: %.2f MH/s, %u cores, jobs %u, results %u (bad %u), "
+               "hw err %.4f, seen %.1f s ago\n", i, peer->status.hashrate_khs / 1e3,
+               peer->status.cores, peer->jobs_sent, peer->results, peer->results_bad,
+               hw_total ? (double)peer->status.hw_invalid / hw_total : 0.0,
+               (double)(now - peer->last_seen_us) / 1e6);
+    }
+    printf("[cluster] total %.2f MH/s, pool shares %u submitted, %u accepted, %u rejected\n",
+           total, pool->shares_submitted, pool->shares_accepted, pool->shares_rejected);
+    coord->last_report_us = now;
 }
 
-// Set real Bitcoin difficulty (will rarely find nonces)
-void set_real_difficulty(void) {
-    // Current Bitcoin difficulty target (as of 2024)
-    uint32_t real_target[8] = {
-        0x00000000, 0x00000000, 0x00000000, 0x00000000,
-        0x00000000, 0x00000000, 0x00000000, 0x00000000  // Very hard target
-    };
-    write_target(real_target);
-    printf("Set real Bitcoin difficulty (very hard target)\n");
+// Empty JOBS message: tells a board the current generation
+static void cluster_send_generation(cluster_coordinator_t* coord, const cluster_peer_t* peer) {
+    cluster_msg_t msg;
+    cluster_send_to(coord, peer, &msg, cluster_encode(&msg, CLUSTER_MSG_JOBS, 0, 0,
+                                                      coord->generation));
 }
 
-// Process Bitcoin block header and prepare mining parameters
-void process_block_header(bitcoin_block_header_t* header, mining_params_t* params) {
-    printf("Processing block header...\n");
-    printf("Version: 0x%08X\n", header->version);
-    printf("Timestamp: %u\n", header->timestamp);
-    printf("Bits: 0x%08X\n", header->bits);
-    printf("Nonce: 0x%08X\n", header->nonce);
-    
-    // For demonstration, we'll use simplified parameters
-    // In a real implementation, you would:
-    // 1. Calculate the SHA-256 mid-state from the first 512 bits of the header
-    // 2. Extract the residual data (remaining bits)
-    // 3. Convert the difficulty bits to a target
-    
-    // Simplified test parameters
-    for (int i = 0; i < 8; i++) {
-        params->mid_state[i] = 0x12345678 + i;  // Test mid-state
+// One coordinator pass: announce a new generation, serve the boards,
+// expire silent ones and report now and then. The announcement is one
+// datagram, so a board still reporting an older generation gets it
+// again in reply to its next STATUS or RESULTS.
+void cluster_coordinator_poll(cluster_coordinator_t* coord) {
+    uint64_t now = miner_time_us();
+    cluster_msg_t msg;
+    struct sockaddr_in from;
+    socklen_t from_len = sizeof(from);
+    int len;
+    
+    // clean_jobs: tell every board straight away, not with its next jobs
+    uint32_t generation = __atomic_load_n(&mining_job_generation, __ATOMIC_ACQUIRE);
+    if (generation != coord->generation) {
+        coord->generation = generation;
+        // The queue may be full of older jobs, keeping fresh ones out
+        job_queue_drain(coord->queue);
+        roller_refill(coord->queue, &coord->pool->roller);
+        for (uint32_t i = 0; i < CLUSTER_MAX_BOARDS; i++) {
+            if (coord->peers[i].active) {
+                cluster_send_generation(coord, &coord->peers[i]);
+            }
+        }
+    }
+    
+    while ((len = recvfrom(coord->sock, &msg, sizeof(msg), 0,
+                           (struct sockaddr*)&from, &from_len)) > 0) {
+        from_len = sizeof(from);
+        cluster_peer_t* peer;
+        if (cluster_decode(&msg, len) != 0 || (peer = cluster_find_peer(coord, &from, now)) == NULL) {
+            continue;
+        }
+        peer->generation = msg.header.generation;
+        if (msg.header.type == CLUSTER_MSG_REQUEST) {
+            cluster_send_jobs(coord, peer, msg.header.count);
+        } else if (msg.header.type == CLUSTER_MSG_RESULTS) {
+            cluster_take_results(coord, peer, &msg);
+        } else if (msg.header.type == CLUSTER_MSG_STATUS && msg.header.count == 1) {
+            peer->status = msg.body.status;
+        }
+        if (peer->generation != coord->generation &&
+            (msg.header.type == CLUSTER_MSG_RESULTS || msg.header.type == CLUSTER_MSG_STATUS)) {
+            cluster_send_generation(coord, peer);
+        }
     }
     
-    params->residual_data[0] = header->nonce;  // Start with the nonce
-    params->residual_data[1] = 0x80000000;     // Padding
-    params->residual_data[2] = 0x00000140;     // Length
+    for (uint32_t i = 0; i < CLUSTER_MAX_BOARDS; i++) {
+        cluster_peer_t* peer = &coord->peers[i];
+        if (peer->active && now - peer->last_seen_us >= CLUSTER_BOARD_TIMEOUT_US) {
+            printf("Cluster: board %u timed out\n", i);
+            peer->active = 0;
+        }
+    }
+    if (now - coord->last_report_us >= TELEMETRY_REPORT_US) {
+        cluster_report(coord, now);
+    }
+}
+
+// Hold the pool session for a cluster of boards until
+// mining_stop_requested is set; needs no miner cores of its own
+void mining_loop_coordinator(const char* host, const char* port, const char* worker,
+                             const char* password, double difficulty, uint32_t version_mask,
+                             uint32_t cluster_port) {
+    static stratum_client_t client;
+    static job_queue_t queue;
+    static cluster_coordinator_t coord;
     
-    // Convert difficulty bits to target
-    uint32_t exp = (header->bits >> 24) & 0xFF;
-    uint32_t mantissa = header->bits & 0xFFFFFF;
+    job_queue_init(&queue);
+    stratum_init(&client, host, port, worker, password, &queue);
+    client.suggested_difficulty = difficulty;
+    client.version_mask_request = version_mask;
+    if (cluster_coordinator_init(&coord, cluster_port, &client, &queue) != 0) {
+        return;
+    }
+    printf("Cluster: coordinating on UDP port %u\n", cluster_port);
     
-    // Simplified target calculation
-    for (int i = 0; i < 8; i++) {
-        params->target[i] = 0xFFFFFFFF;
+    while (!mining_stop_requested) {
+        stratum_refill(&queue, &client);
+        cluster_coordinator_poll(&coord);
+        usleep(miner_poll_interval_us);
     }
-    params->target[0] = mantissa;
     
-    printf("Mining parameters prepared\n");
+    stratum_disconnect(&client);
+    cluster_close(coord.sock);
 }
+#endif
+#endif
 
 // Main mining loop with easy difficulty for testing
 void mining_loop_test(void) {
@@ -218,6 +5240,7 @@ void mining_loop_test(void) {
     
     mining_params_t params;
     process_block_header(&header, &params);
+    memcpy(params.target, test_easy_target, sizeof(params.target));
     
     // Set test difficulty for demonstration
     set_test_difficulty();
@@ -225,6 +5248,7 @@ void mining_loop_test(void) {
     // Write parameters to FPGA
     write_mid_state(params.mid_state);
     write_residual_data(params.residual_data);
+    write_nonce_range(0x00000000, 0xFFFFFFFF);
     
     // Start mining
     start_mining();
@@ -234,28 +5258,34 @@ void mining_loop_test(void) {
         // Check status every second
         if (iteration % 10 == 0) {
             print_mining_status();
+            event_log_drain(EVENT_LOG_DRAIN_BATCH);
         }
         
+        // Wait up to 100ms for FOUND/NOT_FOUND
+        uint32_t events = miner_wait_event(100000);
+        
         // Check if found
-        if (check_found()) {
+        if (events & MINER_EVENT_FOUND) {
             printf("\n GOLDEN NONCE FOUND! \n");
-            uint32_t golden_nonce = get_golden_nonce();
-            printf("Golden Nonce: 0x%08X (%u)\n", golden_nonce, golden_nonce);
             
-            // Stop mining
-            stop_mining();
-            break;
+            // Drain all results; the core keeps hashing the range
+            uint32_t nonces[RESULT_FIFO_DEPTH];
+            uint32_t count = drain_golden_nonces(nonces, RESULT_FIFO_DEPTH);
+            for (uint32_t i = 0; i < count; i++) {
+                printf("Golden Nonce: 0x%08X (%u)\n", nonces[i], nonces[i]);
+                if (verify_golden_nonce(&params, nonces[i])) {
+                    printf("Golden nonce verified on host\n");
+                }
+            }
         }
         
         // Check if not found (reached end of nonce range)
-        uint32_t not_found = read_register(STATUS_NOT_FOUND);
-        if (not_found) {
-            printf("\n No nonce found in current range\n");
+        if (events & MINER_EVENT_NOT_FOUND) {
+            printf("\n End of nonce range reached\n");
             stop_mining();
             break;
         }
         
-        usleep(100000); // 100ms delay
         iteration++;
         
         // Safety check - stop after 1000 iterations (100 seconds)
@@ -278,7 +5308,7 @@ void mining_loop_real(void) {
     bitcoin_block_header_t header = {
         .version = 0x20000000,
         .timestamp = (uint32_t)time(NULL),
-        .bits = 0x1703FFFC,  // Current Bitcoin difficulty
+        .bits = BTC_MAINNET_BITS,  // Current Bitcoin difficulty
         .nonce = 0
     };
     
@@ -291,6 +5321,7 @@ void mining_loop_real(void) {
     // Write parameters to FPGA
     write_mid_state(params.mid_state);
     write_residual_data(params.residual_data);
+    write_nonce_range(0x00000000, 0xFFFFFFFF);
     
     // Start mining
     start_mining();
@@ -300,29 +5331,35 @@ void mining_loop_real(void) {
         // Check status every 10 seconds
         if (iteration % 100 == 0) {
             print_mining_status();
+            event_log_drain(EVENT_LOG_DRAIN_BATCH);
         }
         
+        // Wait up to 100ms for FOUND/NOT_FOUND
+        uint32_t events = miner_wait_event(100000);
+        
         // Check if found (unlikely!)
-        if (check_found()) {
+        if (events & MINER_EVENT_FOUND) {
             printf("\n GOLDEN NONCE FOUND! \n");
             printf("This is extremely unlikely with real difficulty!\n");
-            uint32_t golden_nonce = get_golden_nonce();
-            printf("Golden Nonce: 0x%08X (%u)\n", golden_nonce, golden_nonce);
             
-            // Stop mining
-            stop_mining();
-            break;
+            // Drain all results; the core keeps hashing the range
+            uint32_t nonces[RESULT_FIFO_DEPTH];
+            uint32_t count = drain_golden_nonces(nonces, RESULT_FIFO_DEPTH);
+            for (uint32_t i = 0; i < count; i++) {
+                printf("Golden Nonce: 0x%08X (%u)\n", nonces[i], nonces[i]);
+                if (verify_golden_nonce(&params, nonces[i])) {
+                    printf("Golden nonce verified on host\n");
+                }
+            }
         }
         
         // Check if not found (reached end of nonce range)
-        uint32_t not_found = read_register(STATUS_NOT_FOUND);
-        if (not_found) {
-            printf("\n No nonce found in current range\n");
+        if (events & MINER_EVENT_NOT_FOUND) {
+            printf("\n End of nonce range reached\n");
             stop_mining();
             break;
         }
         
-        usleep(100000); // 100ms delay
         iteration++;
         
         // Safety check - stop after 10000 iterations (1000 seconds)
@@ -337,20 +5374,538 @@ void mining_loop_real(void) {
     printf("Mining loop completed\n");
 }
 
-// Main function
-int main(void) {
-    printf("=== Bitcoin Miner SDK for Zybo Z-10 ===\n");
-    printf("Base Address: 0x%08X\n", MINER_BASE_ADDR);
-    printf("Starting mining demonstration...\n\n");
+// Boot self-test: every core mines known blocks in a narrow window around
+// their golden nonce. A core passes when it reports exactly the known
+// nonce and the host agrees; the window also yields a measured hashrate.
+#ifndef SELFTEST_WINDOW
+#ifdef MINER_USE_SIM
+#define SELFTEST_WINDOW 0x10000    // Nonces per vector
+#else
+#define SELFTEST_WINDOW 0x1000000
+#endif
+#endif
+
+#ifndef SELFTEST_TIMEOUT_US
+#define SELFTEST_TIMEOUT_US 5000000  // Per vector
+#endif
+
+typedef struct {
+    const char* name;
+    bitcoin_block_header_t header;  // nonce = expected golden nonce
+} selftest_vector_t;
+
+static const selftest_vector_t selftest_vectors[] = {
+    { "genesis", {
+        1,
+        { 0 },
+        { 0x3b, 0xa3, 0xed, 0xfd, 0x7a, 0x7b, 0x12, 0xb2, 0x7a, 0xc7, 0x2c, 0x3e,
+          0x67, 0x76, 0x8f, 0x61, 0x7f, 0xc8, 0x1b, 0xc3, 0x88, 0x8a, 0x51, 0x32,
+          0x3a, 0x9f, 0xb8, 0xaa, 0x4b, 0x1e, 0x5e, 0x4a },
+        1231006505, 0x1D00FFFF, 0x7C2BAC1D
+    } },
+    { "block 1", {
+        1,
+        { 0x6f, 0xe2, 0x8c, 0x0a, 0xb6, 0xf1, 0xb3, 0x72, 0xc1, 0xa6, 0xa2, 0x46,
+          0xae, 0x63, 0xf7, 0x4f, 0x93, 0x1e, 0x83, 0x65, 0xe1, 0x5a, 0x08, 0x9c,
+          0x68, 0xd6, 0x19, 0x00, 0x00, 0x00, 0x00, 0x00 },
+        { 0x98, 0x20, 0x51, 0xfd, 0x1e, 0x4b, 0xa7, 0x44, 0xbb, 0xbe, 0x68, 0x0e,
+          0x1f, 0xee, 0x14, 0x67, 0x7b, 0xa1, 0xa3, 0xc3, 0x54, 0x0b, 0xf7, 0xb1,
+          0xcd, 0xb6, 0x06, 0xe8, 0x57, 0x23, 0x3e, 0x0e },
+        1231469665, 0x1D00FFFF, 0x9962E301
+    } }
+};
+
+#define SELFTEST_VECTOR_COUNT (sizeof(selftest_vectors) / sizeof(selftest_vectors[0]))
+
+// Run one vector on the selected core. Returns 0 on pass; hashrate
+// receives the measured H/s.
+static int selftest_run(const selftest_vector_t* vector, double* hashrate) {
+    bitcoin_block_header_t header = vector->header;
+    uint32_t expected = header.nonce;
+    uint32_t start = (expected > SELFTEST_WINDOW / 2) ? expected - SELFTEST_WINDOW / 2 : 0;
+    uint32_t end = start + SELFTEST_WINDOW - 1;
+    uint32_t nonces[RESULT_FIFO_DEPTH];
+    mining_params_t params;
+    uint32_t hits = 0;
+    uint32_t wrong = 0;
+    int done = 0;
     
-    // Initialize FPGA
-    stop_mining(); // Ensure clean state
+    header.nonce = 0;
+    process_block_header(&header, &params);
+    
+    uint64_t t0 = miner_time_us();
+    resume_mining(&params, start, end);
+    while (!done) {
+        uint32_t events = miner_wait_event(SELFTEST_TIMEOUT_US);
+        if (events == 0) {
+            printf("  %s: timeout\n", vector->name);
+            stop_mining();
+            return -1;
+        }
+        done = (events & MINER_EVENT_NOT_FOUND) != 0;
+        
+        // Results may trail NOT_FOUND through the FIFO, so drain either way
+        uint32_t count = drain_golden_nonces(nonces, RESULT_FIFO_DEPTH);
+        for (uint32_t i = 0; i < count; i++) {
+            if (nonces[i] == expected && job_nonce_valid(&params, nonces[i])) {
+                hits++;
+            } else {
+                printf("  %s: unexpected nonce 0x%08X\n", vector->name, nonces[i]);
+                wrong++;
+            }
+        }
+    }
+    uint64_t elapsed_us = miner_time_us() - t0;
+    
+#ifdef MINER_HAS_PERF_COUNTERS
+    uint32_t hashes = read_register(STATUS_HASH_COUNT);
+    uint32_t cycles = read_register(STATUS_CYCLE_COUNT);
+    if (cycles) {
+        *hashrate = (double)hashes * miner_core_clock_hz / (double)cycles;
+    } else
+#endif
+    *hashrate = elapsed_us ? (double)SELFTEST_WINDOW * 1e6 / (double)elapsed_us : 0.0;
+    stop_mining();
+    
+    if (hits != 1 || wrong != 0) {
+        printf("  %s: expected nonce 0x%08X %s\n", vector->name, expected,
+               hits ? "reported more than once" : "not reported");
+        return -1;
+    }
+    return 0;
+}
+
+// Self-test every core. Returns 0 if all pass (go), -1 otherwise.
+int miner_self_test(void) {
+    int failed = 0;
+    
+    printf("Self-test: %u vectors, %u nonces each\n",
+           (unsigned)SELFTEST_VECTOR_COUNT, (unsigned)SELFTEST_WINDOW);
+    for (uint32_t core = 0; core < miner_core_count; core++) {
+        double total = 0.0;
+        int core_failed = 0;
+        
+        select_core(core);
+        for (uint32_t v = 0; v < SELFTEST_VECTOR_COUNT; v++) {
+            double hashrate = 0.0;
+            if (selftest_run(&selftest_vectors[v], &hashrate) != 0) {
+                core_failed = 1;
+            }
+            total += hashrate;
+        }
+        printf("Self-test core %u: %s, %.2f MH/s\n", core, core_failed ? "FAIL" : "PASS",
+               total / SELFTEST_VECTOR_COUNT / 1e6);
+        failed |= core_failed;
+    }
+    select_core(0);
+    event_log_drain(EVENT_LOG_SIZE);
+    return failed ? -1 : 0;
+}
+
+// Driver benchmarks: time register access, job loading, core control
+// and the job/result paths on core 0, against the fabric or the
+// emulated backend. Results go out as CSV (one row per benchmark,
+// nanoseconds) so runs can be compared across driver and bitstream
+// changes.
+#ifndef BENCH_ITERATIONS
+#define BENCH_ITERATIONS 1000
+#endif
+
+#ifndef BENCH_SLOW_ITERATIONS
+#define BENCH_SLOW_ITERATIONS 100  // Operations with a built-in delay
+#endif
+
+#ifndef BENCH_TIMEOUT_US
+#define BENCH_TIMEOUT_US 100000    // Per job turnaround
+#endif
+
+typedef struct {
+    uint32_t count;
+    uint32_t samples[BENCH_ITERATIONS];  // ns
+} bench_stats_t;
+
+static void bench_record(bench_stats_t* stats, uint64_t ns) {
+    if (stats->count < BENCH_ITERATIONS) {
+        stats->samples[stats->count++] = (ns > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)ns;
+    }
+}
+
+static int bench_compare(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Print one CSV row and reset the samples
+static void bench_report(const char* name, bench_stats_t* stats) {
+    uint64_t total = 0;
+    
+    if (stats->count == 0) {
+        printf("%s,0,,,,,\n", name);
+        return;
+    }
+    qsort(stats->samples, stats->count, sizeof(stats->samples[0]), bench_compare);
+    for (uint32_t i = 0; i < stats->count; i++) {
+        total += stats->samples[i];
+    }
+    printf("%s,%u,%u,%u,%u,%u,%llu\n", name, stats->count, stats->samples[0],
+           stats->samples[stats->count / 2], stats->samples[(stats->count * 99) / 100],
+           stats->samples[stats->count - 1], (unsigned long long)(total / stats->count));
+    stats->count = 0;
+}
+
+// Time fn over iterations; one sample per call
+#define BENCH_LOOP(stats, iterations, fn) do {        \
+    for (uint32_t bench_i = 0; bench_i < (iterations); bench_i++) { \
+        uint64_t bench_t0 = miner_time_ns();          \
+        fn;                                           \
+        bench_record((stats), miner_time_ns() - bench_t0); \
+    }                                                 \
+} while (0)
+
+void run_driver_benchmarks(void) {
+    static bench_stats_t stats;
+    static job_template_t tmpl;
+    job_roller_t roller;
+    mining_job_t job;
+    volatile uint32_t sink = 0;
+    
+    demo_template_init(&tmpl);
+    job_roller_init(&roller, &tmpl);
+    job_roller_next(&roller, &job);
+    
+    // Every nonce solves this job, so each turnaround yields a result
+    for (int i = 0; i < 8; i++) {
+        job.params.target[i] = 0xFFFFFFFF;
+    }
+    
+    select_core(0);
+    stop_mining();
+    printf("\n# driver benchmark: backend=%s cores=%u\n", MINER_BACKEND_NAME, miner_core_count);
+    printf("bench,iterations,min_ns,p50_ns,p99_ns,max_ns,avg_ns\n");
+    
+    BENCH_LOOP(&stats, BENCH_ITERATIONS, sink += read_register(STATUS_FOUND));
+    bench_report("reg_read", &stats);
+    BENCH_LOOP(&stats, BENCH_ITERATIONS, write_register(CTRL_IRQ_ACK, 0));
+    bench_report("reg_write", &stats);
+    BENCH_LOOP(&stats, BENCH_ITERATIONS, write_mid_state(job.params.mid_state));
+    bench_report("write_mid_state", &stats);
+    BENCH_LOOP(&stats, BENCH_ITERATIONS, write_residual_data(job.params.residual_data));
+    bench_report("write_residual_data", &stats);
+    BENCH_LOOP(&stats, BENCH_ITERATIONS, write_target(job.params.target));
+    bench_report("write_target", &stats);
+    BENCH_LOOP(&stats, BENCH_ITERATIONS, write_next_job(&job.params));
+    bench_report("write_next_job", &stats);
+    
+#ifdef MINER_USE_JOB_TABLE
+    // One doorbell per batch; drop the ring outside the timing when full
+    miner_job_desc_t descs[JOB_TABLE_PREFETCH];
+    for (uint32_t i = 0; i < JOB_TABLE_PREFETCH; i++) {
+        job_desc_init(&descs[i], &job.params, job.job_id, i, i);
+    }
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+        if (job_table_space() < JOB_TABLE_PREFETCH) {
+            stop_mining();
+        }
+        uint64_t t0 = miner_time_ns();
+        job_table_post(descs, JOB_TABLE_PREFETCH);
+        bench_record(&stats, miner_time_ns() - t0);
+    }
+    bench_report("job_table_post_batch", &stats);
+#endif
+    
+    BENCH_LOOP(&stats, BENCH_SLOW_ITERATIONS, stop_mining());
+    bench_report("stop_mining", &stats);
+    BENCH_LOOP(&stats, BENCH_SLOW_ITERATIONS, sink += get_current_nonce());
+    bench_report("get_current_nonce", &stats);
+    BENCH_LOOP(&stats, BENCH_ITERATIONS, job_roller_next(&roller, &job));
+    bench_report("job_prepare", &stats);
+    for (int i = 0; i < 8; i++) {
+        job.params.target[i] = 0xFFFFFFFF;
+    }
+    
+    // Full turnaround: load a one-nonce job, start it and poll until the
+    // core reports the range done. The result path is the drain and host
+    // check that precede the share hook.
+    static bench_stats_t results;
+    for (uint32_t i = 0; i < BENCH_SLOW_ITERATIONS; i++) {
+        uint32_t nonces[RESULT_FIFO_DEPTH];
+        int valid[RESULT_FIFO_DEPTH];
+        int timed_out = 0;
+        uint64_t t0 = miner_time_ns();
+        uint64_t deadline = miner_time_us() + BENCH_TIMEOUT_US;
+        
+        resume_mining(&job.params, i, i);
+        while (!(read_miner_events(miner_selected) & MINER_EVENT_NOT_FOUND)) {
+            if (miner_time_us() > deadline) {
+                timed_out = 1;
+                break;
+            }
+        }
+        if (!timed_out) {
+            bench_record(&stats, miner_time_ns() - t0);
+        }
+        
+        uint64_t t1 = miner_time_ns();
+        uint32_t count = drain_golden_nonces(nonces, RESULT_FIFO_DEPTH);
+        check_golden_nonces(&job.params, nonces, count, valid);
+        if (count > 0) {
+            bench_record(&results, miner_time_ns() - t1);
+        }
+    }
+    bench_report("job_turnaround", &stats);
+    bench_report("result_to_submit", &results);
+    
+    stop_mining();
+    (void)sink;
+}
+
+// Headless configuration: key=value settings separated by whitespace or
+// newlines, '#' starts a comment. Sources, later ones winning:
+// MINER_BOOT_ARGS built in, the config text (MINER_CONFIG_PATH on Linux,
+// memory at MINER_CONFIG_ADDR on bare metal, e.g. fatload'ed by U-Boot),
+// miner.<key>=value on the kernel command line, then argv.
+//
+//   mode=pool|continuous|test|real|bench|menu|board|coordinator
+//        (default: pool if a pool is set, board if a coordinator is)
+//   pool=stratum+tcp://host:port  worker=name  password=x
+//   difficulty=N  version_mask=hex  poll_us=N  cores=N  clock_hz=N
+//   tune=0|1  (step clock_hz up/down on hardware error rate and die heat)
+//   coordinator=host:port  (board)  cluster_port=N  (coordinator)
+#ifndef MINER_BOOT_ARGS
+#define MINER_BOOT_ARGS ""
+#endif
+
+#ifndef MINER_CONFIG_PATH
+#define MINER_CONFIG_PATH "/etc/fpga_miner.conf"
+#endif
+
+#ifndef MINER_CONFIG_MAX
+#define MINER_CONFIG_MAX 4096  // Bytes of config text read
+#endif
+
+typedef struct {
+    char mode[16];       // Empty: pool if configured, else continuous
+    char pool_host[128];
+    char pool_port[8];
+    char worker[128];
+    char password[64];
+    double difficulty;   // Suggested share difficulty, 0 = pool decides
+    uint32_t version_mask;  // Version rolling mask to request, 0 = off
+    uint32_t poll_us;
+    uint32_t cores;
+    uint32_t clock_hz;   // Core clock for cycle counts, programmed if tuning
+    uint32_t tune;       // Run the clock tuner in the mining loop
+    char coordinator_host[128];  // Cluster coordinator of a board
+    char coordinator_port[8];
+    uint32_t cluster_port;       // UDP port a coordinator listens on
+} miner_config_t;
+
+static void config_defaults(miner_config_t* cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    snprintf(cfg->pool_port, sizeof(cfg->pool_port), "%s", "3333");
+    snprintf(cfg->password, sizeof(cfg->password), "%s", "x");
+    cfg->poll_us = MINER_POLL_INTERVAL_US;
+    cfg->cores = MINER_NUM_CORES;
+    cfg->clock_hz = MINER_CORE_CLOCK_HZ;
+    cfg->version_mask = VERSION_ROLL_MASK;
+#ifdef MINER_USE_CLUSTER
+    snprintf(cfg->coordinator_port, sizeof(cfg->coordinator_port), "%u", MINER_CLUSTER_PORT);
+    cfg->cluster_port = MINER_CLUSTER_PORT;
+#endif
+}
+
+// Accept scheme://host:port, host:port or a bare host (port unchanged)
+static int config_set_address(const char* url, char* host_out, size_t host_size,
+                              char* port_out, size_t port_size) {
+    const char* scheme = strstr(url, "://");
+    const char* host = scheme ? scheme + 3 : url;
+    const char* colon = strrchr(host, ':');
+    size_t host_len = colon ? (size_t)(colon - host) : strlen(host);
+    
+    if (host_len == 0 || host_len >= host_size) {
+        return -1;
+    }
+    memcpy(host_out, host, host_len);
+    host_out[host_len] = '\0';
+    if (colon) {
+        if (strlen(colon + 1) == 0 || strlen(colon + 1) >= port_size) {
+            return -1;
+        }
+        snprintf(port_out, port_size, "%s", colon + 1);
+    }
+    return 0;
+}
+
+static int config_set_u32(uint32_t* field, const char* value) {
+    char* end;
+    unsigned long n = strtoul(value, &end, 0);
+    
+    if (end == value || *end != '\0' || n == 0 || n > 0xFFFFFFFFUL) {
+        return -1;
+    }
+    *field = (uint32_t)n;
+    return 0;
+}
+
+static int config_set_bool(uint32_t* field, const char* value) {
+    if (strcmp(value, "0") != 0 && strcmp(value, "1") != 0) {
+        return -1;
+    }
+    *field = (uint32_t)(value[0] - '0');
+    return 0;
+}
+
+// Apply one setting. Returns 0, or -1 for an unknown key or bad value.
+static int config_set(miner_config_t* cfg, const char* key, const char* value) {
+    if (strcmp(key, "mode") == 0) {
+        snprintf(cfg->mode, sizeof(cfg->mode), "%s", value);
+        return 0;
+    } else if (strcmp(key, "pool") == 0) {
+        return config_set_address(value, cfg->pool_host, sizeof(cfg->pool_host),
+                                  cfg->pool_port, sizeof(cfg->pool_port));
+    } else if (strcmp(key, "coordinator") == 0) {
+        return config_set_address(value, cfg->coordinator_host, sizeof(cfg->coordinator_host),
+                                  cfg->coordinator_port, sizeof(cfg->coordinator_port));
+    } else if (strcmp(key, "worker") == 0) {
+        snprintf(cfg->worker, sizeof(cfg->worker), "%s", value);
+        return 0;
+    } else if (strcmp(key, "password") == 0) {
+        snprintf(cfg->password, sizeof(cfg->password), "%s", value);
+        return 0;
+    } else if (strcmp(key, "difficulty") == 0) {
+        char* end;
+        double difficulty = strtod(value, &end);
+        if (end == value || *end != '\0' || difficulty < 0.0) {
+            return -1;
+        }
+        cfg->difficulty = difficulty;
+        return 0;
+    } else if (strcmp(key, "version_mask") == 0) {
+        char* end;
+        cfg->version_mask = (uint32_t)strtoul(value, &end, 16);
+        return (end == value || *end != '\0') ? -1 : 0;
+    } else if (strcmp(key, "poll_us") == 0) {
+        return config_set_u32(&cfg->poll_us, value);
+    } else if (strcmp(key, "cores") == 0) {
+        return config_set_u32(&cfg->cores, value);
+    } else if (strcmp(key, "clock_hz") == 0) {
+        return config_set_u32(&cfg->clock_hz, value);
+    } else if (strcmp(key, "tune") == 0) {
+        return config_set_bool(&cfg->tune, value);
+    } else if (strcmp(key, "cluster_port") == 0) {
+        return config_set_u32(&cfg->cluster_port, value);
+    }
+    return -1;
+}
+
+// Parse one "key=value" token; with a prefix, tokens without it are
+// someone else's and skipped
+static void config_token(miner_config_t* cfg, char* token, const char* prefix) {
+    char* key = token;
+    
+    if (prefix) {
+        size_t prefix_len = strlen(prefix);
+        if (strncmp(token, prefix, prefix_len) != 0) {
+            return;
+        }
+        key += prefix_len;
+    }
+    
+    char* eq = strchr(key, '=');
+    if (!eq || eq == key) {
+        printf("Config: ignoring '%s'\n", token);
+        return;
+    }
+    *eq = '\0';
+    if (config_set(cfg, key, eq + 1) != 0) {
+        printf("Config: bad setting %s=%s\n", key, eq + 1);
+    }
+}
+
+// Parse config text of up to len bytes; a NUL or any other non-text byte
+// (erased flash, uninitialised memory) ends it
+static void config_parse(miner_config_t* cfg, const char* text, size_t len, const char* prefix) {
+    char token[256];
+    size_t i = 0;
     
-    // Ask user which mode to run
+#define CONFIG_IS_TEXT(c) ((c) == '\t' || (c) == '\n' || (c) == '\r' || ((c) >= 0x20 && (c) < 0x7F))
+    while (i < len && CONFIG_IS_TEXT((unsigned char)text[i])) {
+        unsigned char c = (unsigned char)text[i];
+        
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            i++;
+        } else if (c == '#') {
+            while (i < len && CONFIG_IS_TEXT((unsigned char)text[i]) && text[i] != '\n') {
+                i++;
+            }
+        } else {
+            size_t n = 0;
+            while (i < len && CONFIG_IS_TEXT((unsigned char)text[i]) &&
+                   text[i] != ' ' && text[i] != '\t' && text[i] != '\n' && text[i] != '\r') {
+                if (n < sizeof(token) - 1) {
+                    token[n++] = text[i];
+                }
+                i++;
+            }
+            token[n] = '\0';
+            config_token(cfg, token, prefix);
+        }
+    }
+#undef CONFIG_IS_TEXT
+}
+
+#ifdef __linux__
+// Parse a whole file if it exists. Returns 0 when it was read.
+static int config_parse_file(miner_config_t* cfg, const char* path, const char* prefix) {
+    static char text[MINER_CONFIG_MAX];
+    FILE* file = fopen(path, "r");
+    
+    if (!file) {
+        return -1;
+    }
+    size_t len = fread(text, 1, sizeof(text), file);
+    fclose(file);
+    config_parse(cfg, text, len, prefix);
+    return 0;
+}
+#endif
+
+// Build the configuration from every source in precedence order
+void miner_config_load(miner_config_t* cfg, int argc, char** argv) {
+    static const char boot_args[] = MINER_BOOT_ARGS;
+    
+    config_defaults(cfg);
+    config_parse(cfg, boot_args, sizeof(boot_args) - 1, NULL);
+#ifdef __linux__
+    if (config_parse_file(cfg, MINER_CONFIG_PATH, NULL) == 0) {
+        printf("Config: read %s\n", MINER_CONFIG_PATH);
+    }
+    config_parse_file(cfg, "/proc/cmdline", "miner.");
+#elif defined(MINER_CONFIG_ADDR)
+    config_parse(cfg, (const char*)(uintptr_t)MINER_CONFIG_ADDR, MINER_CONFIG_MAX, NULL);
+#endif
+    for (int i = 1; i < argc; i++) {
+        config_token(cfg, argv[i], NULL);
+    }
+    
+    if (cfg->mode[0] == '\0') {
+        snprintf(cfg->mode, sizeof(cfg->mode), "%s", cfg->pool_host[0] ? "pool" :
+                 cfg->coordinator_host[0] ? "board" : "continuous");
+    }
+}
+
+// Interactive mode menu (mode=menu)
+static void run_menu(void) {
     printf("Choose mining mode:\n");
     printf("1. Test mode (easy difficulty - will find nonces)\n");
     printf("2. Real mode (real difficulty - for observation only)\n");
-    printf("Enter choice (1 or 2): ");
+    printf("3. Continuous mode (job queue, easy difficulty)\n");
+#ifdef MINER_USE_STRATUM
+    printf("4. Pool mode (Stratum v1)\n");
+#endif
+    printf("5. Driver benchmark (CSV)\n");
+    printf("Enter choice: ");
     
     int choice;
     scanf("%d", &choice);
@@ -359,10 +5914,132 @@ int main(void) {
         mining_loop_test();
     } else if (choice == 2) {
         mining_loop_real();
+    } else if (choice == 3) {
+        mining_loop_continuous();
+#ifdef MINER_USE_STRATUM
+    } else if (choice == 4) {
+        char host[128], port[8], worker[128], password[64];
+        printf("Pool host, port, worker and password: ");
+        if (scanf("%127s %7s %127s %63s", host, port, worker, password) == 4) {
+            mining_loop_stratum(host, port, worker, password, 0.0, VERSION_ROLL_MASK);
+        }
+#endif
+    } else if (choice == 5) {
+        run_driver_benchmarks();
     } else {
         printf("Invalid choice, running test mode...\n");
         mining_loop_test();
     }
+}
+
+// Main function
+int main(int argc, char** argv) {
+    miner_config_t config;
+    
+    printf("=== Bitcoin Miner SDK for Zybo Z-10 ===\n");
+    printf("Base Address: 0x%08X\n", MINER_BASE_ADDR);
+    printf("Starting mining demonstration...\n\n");
+    
+    miner_config_load(&config, argc, argv);
+    miner_poll_interval_us = config.poll_us;
+    miner_core_clock_hz = config.clock_hz;
+    printf("Mode: %s, core clock %u Hz\n", config.mode, miner_core_clock_hz);
+    
+    // A coordinator only talks to the pool and the boards
+    if (strcmp(config.mode, "coordinator") == 0) {
+#if defined(MINER_USE_CLUSTER) && defined(MINER_USE_STRATUM)
+        if (config.pool_host[0] == '\0' || config.worker[0] == '\0') {
+            printf("Config: coordinator mode needs pool= and worker=\n");
+            return -1;
+        }
+        printf("Pool %s:%s as %s\n", config.pool_host, config.pool_port, config.worker);
+        mining_loop_coordinator(config.pool_host, config.pool_port, config.worker,
+                                config.password, config.difficulty, config.version_mask,
+                                config.cluster_port);
+        return 0;
+#else
+        printf("Config: coordinator mode needs a MINER_USE_CLUSTER and MINER_USE_STRATUM build\n");
+        return -1;
+#endif
+    }
+    
+    // Initialize FPGA
+    if (miner_backend_init() != 0) {
+        return -1;
+    }
+    miner_cores_init(config.cores);
+    stop_all_cores(); // Ensure clean state
+    printf("Miner cores: %u\n", miner_core_count);
+#ifdef MINER_USE_JOB_TABLE
+    if (job_table_init() != 0) {
+        return -1;
+    }
+    printf("Job table: %u descriptors per core at 0x%08X\n",
+           JOB_TABLE_ENTRIES, MINER_JOB_TABLE_ADDR);
+#endif
+    
+    if (miner_irq_init(NULL, NULL) == 0) {
+        printf("Miner interrupt enabled (IRQ %d)\n", MINER_IRQ_ID);
+    } else {
+        printf("Miner interrupt unavailable, polling every %u us\n", miner_poll_interval_us);
+    }
+    
+#ifndef MINER_SKIP_SELFTEST
+    // No-go boards must not join the pool
+    if (miner_self_test() != 0) {
+        printf("SELF-TEST FAILED, not mining\n");
+        return -1;
+    }
+#endif
+    
+    if (config.tune) {
+        if (clock_tune_init(&miner_clock_tuner) == 0) {
+            printf("Clock tuning from %u Hz\n", miner_core_clock_hz);
+        } else {
+            printf("Clock tuning unavailable, staying at %u Hz\n", miner_core_clock_hz);
+        }
+    }
+    
+    // Headless modes start straight away; pool and continuous run until
+    // mining_stop_requested
+    if (strcmp(config.mode, "pool") == 0) {
+#ifdef MINER_USE_STRATUM
+        if (config.pool_host[0] == '\0' || config.worker[0] == '\0') {
+            printf("Config: pool mode needs pool= and worker=\n");
+            return -1;
+        }
+        printf("Pool %s:%s as %s\n", config.pool_host, config.pool_port, config.worker);
+        mining_loop_stratum(config.pool_host, config.pool_port, config.worker,
+                            config.password, config.difficulty, config.version_mask);
+#else
+        printf("Config: pool mode needs a MINER_USE_STRATUM build\n");
+        return -1;
+#endif
+    } else if (strcmp(config.mode, "board") == 0) {
+#ifdef MINER_USE_CLUSTER
+        if (config.coordinator_host[0] == '\0') {
+            printf("Config: board mode needs coordinator=\n");
+            return -1;
+        }
+        mining_loop_board(config.coordinator_host, config.coordinator_port);
+#else
+        printf("Config: board mode needs a MINER_USE_CLUSTER build\n");
+        return -1;
+#endif
+    } else if (strcmp(config.mode, "continuous") == 0) {
+        mining_loop_continuous();
+    } else if (strcmp(config.mode, "test") == 0) {
+        mining_loop_test();
+    } else if (strcmp(config.mode, "real") == 0) {
+        mining_loop_real();
+    } else if (strcmp(config.mode, "bench") == 0) {
+        run_driver_benchmarks();
+    } else if (strcmp(config.mode, "menu") == 0) {
+        run_menu();
+    } else {
+        printf("Config: unknown mode '%s'\n", config.mode);
+        return -1;
+    }
     
     printf("\nMining demonstration completed\n");
     return 0;